@@ -0,0 +1,97 @@
+#include <huffman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#define COEFFICIENTS (1 << 22) // Coefficients generated, fed ROUNDS times to each coder
+#define ROUNDS 4
+#define SCALE 3.0 // Mean magnitude of the quantized coefficients, most of them are small
+#define LIMIT 1023 // Largest magnitude both coders can encode
+
+int cascade_fill(BUFFER *, int); // fill_buffer as it was before the table, through the range chains of huffman_code and category
+double run(int (*)(BUFFER *, int), const int *, unsigned long *); // Seconds to feed every coefficient ROUNDS times, with a checksum of the words
+int laplacian(); // Random coefficient with a Laplacian distribution, like the quantized AC
+
+int main()
+{
+    int *values = (int *) malloc(COEFFICIENTS * sizeof(int));
+    unsigned long sums[2] = { 0, 0 };
+    double seconds[2] = { 0.0, 0.0 }, total = (double) COEFFICIENTS * ROUNDS;
+    int err = 1;
+    if(values != NULL)
+    {
+        srand(1);
+        for(int k = 0; k < COEFFICIENTS; k++)
+        {
+            values[k] = laplacian();
+        }
+        init_huffman_table();
+        seconds[0] = run(cascade_fill, values, &sums[0]);
+        seconds[1] = run(fill_buffer, values, &sums[1]);
+        printf("branch cascade: %7.1f Mcoef/s\n", total / seconds[0] / 1e6);
+        printf("table lookup:   %7.1f Mcoef/s (%.2fx)\n", total / seconds[1] / 1e6, seconds[0] / seconds[1]);
+        err = (sums[0] == sums[1]) ? 0 : 1;
+        printf("words %s\n", (err == 0) ? "identical" : "DIFFER");
+        free(values);
+    }
+    return err;
+}
+
+int cascade_fill(BUFFER *buffer, int data)
+{
+    unsigned int code = huffman_code(data);
+    int cat = -1, status = -1;
+    if(data == 1 || data == -1)
+    {
+        cat = 1;
+    }
+    else if((data >= -7 && data <= -4) || (data >= 4 && data <= 7))
+    {
+        cat = 3;
+    }
+    else
+    {
+        cat = category(code);
+    }
+    if(cat >= 0 && buffer->remaining_bits >= (CATEGORY_LENGTH[cat] + 8)) // The necessary bits plus EOB prefix
+    {
+        buffer->buffer = (buffer->buffer << CATEGORY_LENGTH[cat]) | code;
+        buffer->remaining_bits -= CATEGORY_LENGTH[cat];
+        status = 0;
+    }
+    return status;
+}
+
+double run(int (*fill)(BUFFER *, int), const int *values, unsigned long *sum)
+{
+    struct timespec start, end;
+    BUFFER b;
+    b.buffer = 0;
+    b.remaining_bits = 64;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int round = 0; round < ROUNDS; round++)
+    {
+        for(int k = 0; k < COEFFICIENTS; k++)
+        {
+            if(fill(&b, values[k]) != 0) // A full word is closed and a new one started, as write_in does
+            {
+                *sum = (*sum * 31) + b.buffer;
+                b.buffer = 0;
+                b.remaining_bits = 64;
+                fill(&b, values[k]);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *sum = (*sum * 31) + b.buffer;
+    return (double) (end.tv_sec - start.tv_sec) + ((double) (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+int laplacian()
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    int value = (int) floor(-log(u) * SCALE);
+    if(value > LIMIT) value = LIMIT;
+    return ((rand() & 1) != 0) ? -value : value;
+}
@@ -0,0 +1,124 @@
+#include <bmp_handler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define ROUNDS 5 // Runs of each reader, the best one is kept so that the file is in the page cache
+
+int per_pixel_read(const char *); // The reader before the bands: three 1 byte freads per pixel and the conversion in double, -1 if it cannot
+int band_read(const char *); // bmp_read_file, -1 if it cannot
+int mapped_read(const char *); // bmp_map_file, -1 if it cannot
+double best(int (*)(const char *), const char *); // Seconds of the fastest of ROUNDS runs of a reader, negative if it failed
+
+int main(int argc, char *argv[])
+{
+    const char *file_name = (argc > 1) ? argv[1] : "./samples/rainbowgirl.bmp";
+    const char *names[3] = { "per pixel fread", "bmp_read_file", "bmp_map_file" };
+    int (*readers[3])(const char *) = { per_pixel_read, band_read, mapped_read };
+    struct stat st;
+    double seconds = 0.0, megabytes = 0.0;
+    int err = 0;
+    if(stat(file_name, &st) == 0)
+    {
+        megabytes = (double) st.st_size / 1e6;
+        printf("%s, %.1f MB, best of %d runs\n", file_name, megabytes, ROUNDS);
+        for(int k = 0; k < 3; k++)
+        {
+            seconds = best(readers[k], file_name);
+            if(seconds > 0.0)
+            {
+                printf("%-16s %7.1f MB/s\n", names[k], megabytes / seconds);
+            }
+            else
+            {
+                printf("%-16s FAILED\n", names[k]);
+                err = 1;
+            }
+        }
+    }
+    else
+    {
+        printf("Can not open %s\n", file_name);
+        err = 1;
+    }
+    return err;
+}
+
+int per_pixel_read(const char *file_name)
+{
+    FILE *arq = fopen(file_name, "rb");
+    unsigned char header[54], r = 0x00, g = 0x00, b = 0x00;
+    unsigned int offset = 0, width = 0, height = 0;
+    size_t pixels = 0;
+    double *y = NULL, *cb = NULL, *cr = NULL;
+    int err = -1;
+    if(arq != NULL)
+    {
+        if(fread(header, 1, sizeof(header), arq) == sizeof(header))
+        {
+            memcpy(&offset, header + 10, sizeof(unsigned int));
+            memcpy(&width, header + 18, sizeof(unsigned int));
+            memcpy(&height, header + 22, sizeof(unsigned int));
+            pixels = ((size_t) width * height / 64) * 64;
+            y = (double *) malloc(3 * pixels * sizeof(double));
+            if(y != NULL)
+            {
+                cb = y + pixels;
+                cr = cb + pixels;
+                fseek(arq, offset, SEEK_SET);
+                for(size_t k = 0; k < pixels; k++)
+                {
+                    fread(&b, sizeof(unsigned char), 1, arq);
+                    fread(&g, sizeof(unsigned char), 1, arq);
+                    fread(&r, sizeof(unsigned char), 1, arq);
+                    y[k] = (0.299 * r) + (0.587 * g) + (0.114 * b);
+                    cb[k] = 0.564 * (b - y[k]);
+                    cr[k] = 0.713 * (r - y[k]);
+                }
+                free(y);
+                err = 0;
+            }
+        }
+        fclose(arq);
+    }
+    return err;
+}
+
+int band_read(const char *file_name)
+{
+    BMP_FILE *bmp = bmp_read_file(file_name);
+    int err = (bmp != NULL) ? 0 : -1;
+    bmp_destroy(&bmp);
+    return err;
+}
+
+int mapped_read(const char *file_name)
+{
+    BMP_FILE *bmp = bmp_map_file(file_name);
+    int err = (bmp != NULL) ? 0 : -1;
+    bmp_destroy(&bmp);
+    return err;
+}
+
+double best(int (*reader)(const char *), const char *file_name)
+{
+    struct timespec start, end;
+    double seconds = 0.0, fastest = -1.0;
+    for(int k = 0; k < ROUNDS && (k == 0 || fastest > 0.0); k++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if(reader(file_name) == 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            seconds = (double) (end.tv_sec - start.tv_sec) + ((double) (end.tv_nsec - start.tv_nsec) / 1e9);
+            if(fastest < 0.0 || seconds < fastest) fastest = seconds;
+        }
+        else
+        {
+            fastest = -1.0;
+        }
+    }
+    return fastest;
+}
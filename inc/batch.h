@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+	#define BATCH_H
+
+		// Options of -c applied to every image of a batch
+		typedef struct t_batch_settings
+		{
+			unsigned char engine; // One of the DCT_* engines
+			unsigned short format; // One of the FORMAT_* layouts
+			unsigned short predictor; // One of the PREDICT_* delta encodings
+			unsigned int segment_blocks; // See bmp_set_segments
+			unsigned int index_blocks; // See bmp_set_index
+			unsigned int threads; // Threads shared by all the images, 0 uses one by core
+		} BATCH_SETTINGS;
+
+		// Totals of a batch, for the throughput
+		typedef struct t_batch_report
+		{
+			unsigned int images; // Images found
+			unsigned int failed; // Images that could not be read or written
+			unsigned long long read_bytes; // Size of the images compressed
+			unsigned long long written_bytes; // Size of the compressed files
+			double seconds; // Wall time from the first read to the last write
+		} BATCH_REPORT;
+
+		// Compresses every .bmp of a directory, or every file listed in a manifest (one path by line), into a directory, as <name>.cmp
+		int batch_compress(const char *, const char *, const BATCH_SETTINGS *, BATCH_REPORT *);
+#endif
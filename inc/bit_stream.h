@@ -0,0 +1,76 @@
+#ifndef BIT_STREAM_H
+    #define BIT_STREAM_H
+
+        #include <stdio.h>
+
+        #define BIT_WRITER_CAPACITY (1 << 20) // Default size of the output buffer (1 MB)
+
+        // Output buffer of the entropy coder, flushed to a file in big chunks
+        typedef struct t_bit_writer
+        {
+            unsigned char *data; // Bytes not flushed yet
+            size_t size; // Bytes used in data
+            size_t capacity; // Bytes allocated for data
+            size_t flushed; // Bytes already written in the file
+            FILE *arq; // Where the bytes go, NULL keeps them all in memory and grows data when full
+            unsigned long accumulator; // Bits not yet sent to data, right aligned
+            unsigned char bits; // Quantity of bits in accumulator
+        } BIT_WRITER;
+
+        #define BIT_READER_PADDING 8 // Zero bytes after the input, so a refill can always load 8 bytes
+
+        // Input of the entropy decoder, the whole coded data is kept in memory
+        typedef struct t_bit_reader
+        {
+            unsigned char *data; // Coded bytes followed by BIT_READER_PADDING zeros
+            size_t size; // Coded bytes in data
+            size_t position; // Next byte of data to enter the window, past size the stream reads as zeros
+            unsigned long window; // Next bits of the stream, left aligned, below the valid ones the start of the next byte
+            unsigned char bits; // Quantity of valid bits in window, at least 56 after a refill
+        } BIT_READER;
+
+        int bit_writer_open(BIT_WRITER *, FILE *, size_t); // Allocates the buffer, 0 as size uses BIT_WRITER_CAPACITY
+        void bit_writer_word(BIT_WRITER *, unsigned long); // Appends a 64 bits word, in the machine byte order
+        void bit_writer_bits(BIT_WRITER *, unsigned int, unsigned char); // Appends up to 32 bits, most significant first
+        void bit_writer_align(BIT_WRITER *); // Pads the bits with zeros up to the next byte
+        void bit_writer_bytes(BIT_WRITER *, const unsigned char *, size_t); // Pads up to the next byte, then appends whole bytes
+        size_t bit_writer_tell(const BIT_WRITER *); // Bits appended since the writer was opened
+        int bit_writer_flush(BIT_WRITER *); // Writes the buffered bytes in the file
+        unsigned char *bit_writer_swap(BIT_WRITER *, unsigned char *, size_t, size_t *); // Returns the buffered bytes and their quantity and goes on in the given buffer of that capacity, for bytes written by another thread
+        void bit_writer_close(BIT_WRITER *); // Flushes and frees the buffer
+
+        int bit_reader_open(BIT_READER *, FILE *); // Reads the rest of the file in memory and fills the window
+        unsigned long bit_reader_word(BIT_READER *); // Consumes 64 bits, returned in the machine byte order like bit_writer_word wrote them
+        void bit_reader_seek(BIT_READER *, size_t); // Restarts the window at a bit position of the data
+        void bit_reader_close(BIT_READER *); // Frees the buffer
+
+        // Called once per decoded symbol, so they live here to be inlined in the decoders
+
+        // Tops up the window to 56 bits or more, without branches
+        static inline void bit_reader_fill(BIT_READER *reader)
+        {
+            // Loads the 8 bytes at the position big endian and keeps the whole bytes that fit below the valid bits.
+            // Bits of a partial byte are loaded again by the next refill, at the same place, so the OR keeps them right.
+            // Past the end the load stays on the zero padding, the position keeps counting to know how far it went.
+            const unsigned char *p = reader->data + ((reader->position < reader->size) ? reader->position : reader->size);
+            unsigned long bytes = ((unsigned long) p[0] << 56) | ((unsigned long) p[1] << 48) | ((unsigned long) p[2] << 40) | ((unsigned long) p[3] << 32) |
+                                  ((unsigned long) p[4] << 24) | ((unsigned long) p[5] << 16) | ((unsigned long) p[6] << 8) | (unsigned long) p[7];
+            reader->window |= bytes >> reader->bits;
+            reader->position += (63 - reader->bits) >> 3;
+            reader->bits |= 56;
+        }
+
+        // Consumes up to 32 bits of the window and refills it
+        static inline void bit_reader_skip(BIT_READER *reader, unsigned char length)
+        {
+            reader->window <<= length;
+            reader->bits -= length;
+            bit_reader_fill(reader);
+        }
+
+        // Bits consumed since the start of the data, past size * 8 the data is over
+        static inline size_t bit_reader_tell(const BIT_READER *reader)
+        {
+            return (reader->position * 8) - reader->bits;
+        }
+#endif
@@ -1,18 +1,48 @@
 #ifndef BMP_HANDLER_H
 	#define BMP_HANDLER_H
 
+		#include <thread_pool.h>
+
+		#define DCT_REFERENCE 0 // Separable DCT-II straight from the cosine table
+		#define DCT_FAST 1 // AAN factored DCT-II, its output scaling is merged into the quantization
+		#define DCT_FLOAT 2 // Matrix DCT-II in float32, vectorized for the running CPU
+		#define DCT_INT16 3 // Matrix DCT-II in int16 fixed point, vectorized for the running CPU
+
+		#define FORMAT_WORDS 0 // Every block in its own 64 bits words, closed by an EOB byte and padded
+		#define FORMAT_STREAM 1 // The blocks back to back in one bitstream, a block ends with an EOB symbol
+		#define FORMAT_RUN_SIZE 2 // Same bitstream, with JPEG (run, size) symbols and the standard JPEG Huffman tables
+		#define FORMAT_OPTIMIZED 3 // Same as FORMAT_RUN_SIZE, with Huffman tables made for the image and stored before the bitstream
+		#define FORMAT_RANS 4 // Interleaved rANS, with adaptive models of the coefficient sizes by channel and zig zag position
+
+		#define PREDICT_ZIGZAG 0 // Every coefficient is coded as its difference to the previous one in zig zag order of the block
+		#define PREDICT_DC 1 // Only the DC is predicted, from the DC of the previous block of the same channel
+
+		#define SEGMENTS_FLAG 0x8000 // Set with the format in bmpReserverd1 of the files written before the container when an index of segments starts the data
+		#define INDEX_FLAG 0x4000 // Set the same way when an index of block offsets follows the one of segments
+
 		typedef struct t_bmp_channels BMP_CHANNELS; // Channels of a BMP file (YCbCr)
 		typedef struct t_bmp_file BMP_FILE; // The BMP file representation
 
 		BMP_FILE *bmp_read_file(const char *); // Read a BMP file and return the content stored
+		BMP_FILE *bmp_map_file(const char *); // Same as bmp_read_file, but converts straight from a memory mapping of the file
 		int bmp_write_file(const char *, BMP_FILE *); // Write a BMP file in the disk
+		void bmp_set_dct_engine(BMP_FILE *, unsigned char); // Selects the DCT used by bmp_dct and the matching quantization tables
+		void bmp_set_threads(BMP_FILE *, unsigned int); // Threads of the block stages (DCT, quantization, zig zag delta), 0 uses one by core
+		void bmp_set_pool(BMP_FILE *, THREAD_POOL *); // Runs the block stages in a pool shared with other files, which stays alive after bmp_destroy
+		void bmp_init_tables(); // Builds the tables shared by every file up front, before several threads handle files at once
+		void bmp_set_format(BMP_FILE *, unsigned short); // Selects the layout of the compressed data written by bmp_compress
 		void bmp_dct(BMP_FILE *, char); // Calculates the DCT-II 
 		void bmp_quantization(BMP_FILE *); // Apply the quantization in all channels
 		void bmp_inverse_quantization(BMP_FILE *); // Apply the inverse quantization in all channels
+		void bmp_set_predictor(BMP_FILE *, unsigned short); // Selects the delta encoding used by bmp_diff_encode
+		void bmp_set_segments(BMP_FILE *, unsigned int); // Splits the coded data in independently decodable segments of that many blocks, 0 keeps one segment
+		void bmp_set_index(BMP_FILE *, unsigned int); // Records where every that many blocks start in the coded data, so the decoder can split it between threads, 0 records nothing
 		void bmp_diff_encode(BMP_FILE *); // Calculate delta encoding for every image 8x8 block
 		void bmp_diff_decode(BMP_FILE *); // Decodes delta encoding for every image 8x8 block
-		void bmp_compress(BMP_FILE *, const char *); // Creates frame buffer and save file in a compressed format
+		int bmp_compress(BMP_FILE *, const char *); // Creates frame buffer and save file in a compressed format, -1 if the file could not be written whole
+		int bmp_compress_stream(const char *, const char *, unsigned short, unsigned short, unsigned int, unsigned int); // Compress a BMP file band by band in a pipeline of threads (reader, that many transform workers, encoder and writer), with memory bounded by the image width
 		BMP_FILE *bmp_decompress(const char *); // Decompress file compressed by bmp_compress
+		BMP_FILE *bmp_decompress_parallel(const char *, unsigned int); // Same as bmp_decompress, with that many threads (see bmp_set_threads) kept for the next stages
 		BMP_CHANNELS *bmp_get_channels();
 		void bmp_destroy(BMP_FILE **); // Free the memory used by BMP file 
 #endif
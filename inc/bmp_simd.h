@@ -0,0 +1,21 @@
+#ifndef BMP_SIMD_H
+	#define BMP_SIMD_H
+
+		#define SIMD_SCALAR 0 // Plain C kernels
+		#define SIMD_SSE2 1 // 128 bits kernels
+		#define SIMD_AVX2 2 // 256 bits kernels
+
+		// Kernels chosen for the running CPU
+		typedef struct t_simd_kernels
+		{
+			unsigned char isa; // SIMD_SCALAR, SIMD_SSE2 or SIMD_AVX2
+			void (*foward_dct_float)(double *); // Foward DCT-II of a 8x8 block in float32
+			void (*inverse_dct_float)(double *); // Inverse DCT-II of a 8x8 block in float32
+			void (*foward_dct_int16)(double *); // Foward DCT-II of a 8x8 block in int16 fixed point
+			void (*inverse_dct_int16)(double *); // Inverse DCT-II of a 8x8 block in int16 fixed point
+			void (*bgr_to_ycbcr)(const unsigned char *, double *, double *, double *, unsigned int); // Interleaved BGR24 pixels to planar YCbCr, in fixed point
+			void (*ycbcr_to_bgr)(const double *, const double *, const double *, unsigned char *, unsigned int); // Planar YCbCr to interleaved BGR24 pixels, rounded and clamped
+		} SIMD_KERNELS;
+
+		const SIMD_KERNELS *simd_kernels(); // Detects the CPU on the first call, whichever threads make it at once, and returns the kernels to use
+#endif
@@ -0,0 +1,41 @@
+#ifndef CONTAINER_H
+    #define CONTAINER_H
+
+        #include <stdio.h>
+
+        #define CONTAINER_MAGIC "BMPZ" // First 4 bytes of a compressed file, the files before the container start with the BMP signature
+        #define CONTAINER_VERSION 1 // Layout written by this program, a decoder refuses newer ones
+        #define CONTAINER_HEADER_BYTES 24 // Fixed header, a newer version may make it longer
+        #define CONTAINER_BMP_HEADER 54 // Bytes of the BMP header kept in the BMPH chunk
+        #define SUBSAMPLING_444 0 // The three channels at full resolution
+
+        // Everything a decoder needs to know about a compressed file, in little endian on the disk:
+        // magic, version (u16), header bytes (u16), width (u32), height (u32), format (u16), predictor (u16),
+        // DCT engine (u8), subsampling (u8), chunks (u16), then the chunks, each a 4 letters tag, its length (u32) and its bytes:
+        // QTAB the quantization tables, BMPH the BMP header of the image, SIDX the segments, BIDX the block index,
+        // and DATA the coded blocks, always the last one. A decoder skips the chunks it does not know.
+        typedef struct t_container
+        {
+            unsigned short version;
+            unsigned int width;
+            unsigned int height;
+            unsigned short format; // One of the FORMAT_* entropy modes
+            unsigned short predictor; // One of the PREDICT_* delta encodings
+            unsigned char dct_engine; // DCT_* engine of the encoder, the decoder is free to use another
+            unsigned char subsampling; // One of the SUBSAMPLING_* layouts of the channels
+            unsigned char quant[2][64]; // Quantization tables of luminance and chrominance, row by row
+            unsigned char bmp_header[CONTAINER_BMP_HEADER]; // BMP header to give back to the decoded image
+            unsigned char has_bmp_header; // 0 when the file has no BMPH chunk
+            unsigned int segment_blocks; // Blocks by segment, 0 without SIDX chunk
+            unsigned int segments; // Entries of offsets
+            unsigned int *offsets; // Byte offsets of the segments from the start of the DATA bytes
+            unsigned int index_blocks; // Blocks by entry of the block index, 0 without BIDX chunk
+            unsigned int entries; // Entries of index
+            unsigned int *index; // Bit offsets of the runs of blocks from the start of their segment
+            unsigned long long data_bytes; // Coded bytes of the DATA chunk, 0 when unknown, stored as 0 past 4 GB
+        } CONTAINER;
+
+        void container_write(FILE *, const CONTAINER *); // Writes the header and every chunk up to the start of the DATA bytes
+        int container_read(FILE *, CONTAINER *); // Reads the header and the chunks and stops at the start of the DATA bytes, sets the error and returns -1 if it cannot
+        void container_free(CONTAINER *); // Frees the offsets and the index
+#endif
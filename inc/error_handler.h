@@ -7,6 +7,10 @@
         #define ERR_NOT_BITMAP 250
         #define ERR_CREATE_BITMAP 300
         #define ERR_BMP_NOT_EXIST 350
+        #define ERR_CORRUPTED_FILE 400
+        #define ERR_UNSUPPORTED_FILE 450
+        #define WARN_STANDARD_TABLES 500 // Warnings are only printed, never left in ERROR, the file is still written whole
+        #define WARN_STREAM_RUN_SIZE 550
 
         void error_catch(unsigned int err_code);
 #endif
\ No newline at end of file
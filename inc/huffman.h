@@ -0,0 +1,19 @@
+#ifndef HUFFMAN_H
+    #define HUFFMAN_H
+
+        // Huffman coder of the words layout, defined in bmp_handler.c and shared with bench/bench_entropy.c
+
+        // Structure used like a buffer to write in a file
+        typedef struct t_buffer
+        {
+            unsigned long buffer; // Buffer size of 8 bytes long
+            unsigned char remaining_bits; // Quantity of free bits in buffer
+        } BUFFER;
+
+        extern const unsigned char CATEGORY_LENGTH[11]; // Length of the Huffman code of each category, 0 for the categories without code
+
+        void init_huffman_table(); // Computes the code and the length of every value in HUFFMAN_TABLE, and fills DECODE_TABLE from it
+        unsigned int huffman_code(int); // Returns the correspondent huffman code of value 'value'
+        int category(unsigned int); // Given then huffman code 'code', returns the category of the bit stream
+        int fill_buffer(BUFFER *, int); // Function to fill 8 byte buffer
+#endif
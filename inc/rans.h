@@ -0,0 +1,52 @@
+#ifndef RANS_H
+    #define RANS_H
+
+        #include <stddef.h>
+
+        #define RANS_SCALE_BITS 15 // Precision of the probabilities
+        #define RANS_TOTAL (1 << RANS_SCALE_BITS) // Sum of the frequencies of a model
+        #define RANS_LOW (1U << 23) // Lower bound of the normalized state, it's renormalized a byte at a time
+        #define RANS_MAX_SYMBOLS 16 // Largest alphabet of a model
+        #define RANS_RATE 5 // Adaptation speed of the models, each symbol moves the distribution by 1/32 towards it
+
+        // Adaptive distribution of a small alphabet, its frequencies always sum to RANS_TOTAL
+        typedef struct t_rans_model
+        {
+            int cdf[RANS_MAX_SYMBOLS + 1]; // Cumulative frequency of the symbols before each one, cdf[symbols] is RANS_TOTAL
+            unsigned char symbols; // Size of the alphabet
+        } RANS_MODEL;
+
+        // Slot of a symbol in [0, RANS_TOTAL), as the encoder records it
+        typedef struct t_rans_symbol
+        {
+            unsigned short start; // First slot of the symbol
+            unsigned short freq; // Quantity of slots of the symbol
+        } RANS_SYMBOL;
+
+        // Encoder with two interleaved states, it records the symbols going forward and codes them backwards when finished
+        typedef struct t_rans_encoder
+        {
+            RANS_SYMBOL *symbols; // Recorded symbols
+            size_t count; // Symbols used
+            size_t capacity; // Symbols allocated
+        } RANS_ENCODER;
+
+        // Decoder with two interleaved states, reading from a memory buffer
+        typedef struct t_rans_decoder
+        {
+            const unsigned char *data; // Next byte to enter a state
+            const unsigned char *end; // End of the buffer, zeros are read past it
+            unsigned int state[2]; // One state per parity of the symbol index
+            unsigned char next; // State of the next symbol
+        } RANS_DECODER;
+
+        void rans_model_init(RANS_MODEL *, unsigned char); // Starts a model with a uniform distribution
+        int rans_encoder_open(RANS_ENCODER *); // Allocates the symbol record
+        void rans_encode(RANS_ENCODER *, RANS_MODEL *, unsigned char); // Records a symbol and adapts the model to it
+        void rans_encode_bits(RANS_ENCODER *, unsigned int, unsigned char); // Records up to RANS_SCALE_BITS raw bits, all values equally likely
+        unsigned char *rans_encoder_finish(RANS_ENCODER *, size_t *); // Codes the record and returns the bytes (to be freed) and their quantity
+        void rans_encoder_close(RANS_ENCODER *); // Frees the record
+        void rans_decoder_open(RANS_DECODER *, const unsigned char *, size_t); // Reads the initial states from the buffer
+        unsigned char rans_decode(RANS_DECODER *, RANS_MODEL *); // Decodes a symbol and adapts the model to it
+        unsigned int rans_decode_bits(RANS_DECODER *, unsigned char); // Decodes raw bits recorded by rans_encode_bits
+#endif
@@ -0,0 +1,10 @@
+#ifndef RING_BUFFER_H
+    #define RING_BUFFER_H
+
+        typedef struct t_ring_buffer RING_BUFFER; // Bounded queue of pointers from one producer thread to one consumer thread, without locks
+
+        RING_BUFFER *ring_buffer_create(unsigned int); // Room for at least that many items, rounded up to a power of two
+        void ring_buffer_push(RING_BUFFER *, void *); // Appends an item, NULL included, waiting while the ring is full, called by the producer only
+        void *ring_buffer_pop(RING_BUFFER *); // Removes the oldest item, waiting while the ring is empty, called by the consumer only
+        void ring_buffer_destroy(RING_BUFFER **); // Frees the ring, the items left in it are not freed
+#endif
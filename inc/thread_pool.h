@@ -0,0 +1,14 @@
+#ifndef THREAD_POOL_H
+    #define THREAD_POOL_H
+
+        // Work of a job, runs the items [first, first + count) with the argument given to thread_pool_run
+        typedef void (*THREAD_TASK)(void *, unsigned int, unsigned int);
+
+        typedef struct t_thread_pool THREAD_POOL; // Workers waiting for jobs, the calling thread works on each job too, and the idle workers help with any open job
+
+        THREAD_POOL *thread_pool_create(unsigned int); // Starts a pool of that many threads counting the caller, 0 uses one by core
+        void thread_pool_run(THREAD_POOL *, THREAD_TASK, void *, unsigned int, unsigned int); // Splits the items in chunks of that size (0 chooses it) and returns when all are done, a NULL pool runs them in the caller, a task can post jobs of its own
+        unsigned int thread_pool_threads(const THREAD_POOL *); // Threads working on each job, 1 for a NULL pool
+        unsigned int thread_pool_cores(); // Cores of the running machine
+        void thread_pool_destroy(THREAD_POOL **); // Stops the workers and frees the pool
+#endif
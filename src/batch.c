@@ -0,0 +1,343 @@
+#include <batch.h>
+#include <bmp_handler.h>
+#include <thread_pool.h>
+#include <error_handler.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define MANIFEST_LINE 4096 // Longest line of a manifest
+#define FIRST_NAMES 64 // Room for names before the list grows
+
+extern _Thread_local unsigned int ERROR;
+
+// Image of a batch, the biggest ones are started first so no big image is left for the end
+typedef struct t_batch_image
+{
+	char *input;
+	char *output;
+	unsigned long long read_bytes;
+	unsigned long long written_bytes;
+	unsigned char failed;
+	unsigned char duplicate; // Its output is the one of an image before it, so it is neither written nor removed
+} BATCH_IMAGE;
+
+// Images compressed in parallel by batch_compress
+typedef struct t_batch_job
+{
+	const BATCH_SETTINGS *settings;
+	THREAD_POOL *pool; // Shared by the images and by their block stages
+	BATCH_IMAGE *images;
+} BATCH_JOB;
+
+int add_image(BATCH_IMAGE **, unsigned int *, unsigned int *, const char *, const char *); // Appends an input and its output name in the directory, growing the list
+unsigned int list_directory(const char *, const char *, BATCH_IMAGE **); // Lists the .bmp files of a directory, returns how many
+unsigned int read_manifest(const char *, const char *, BATCH_IMAGE **); // Lists the files of a manifest, skipping empty lines and the ones starting with #, returns how many
+int has_bmp_extension(const char *); // 1 if the name ends with .bmp in any case
+int compare_images(const void *, const void *); // Biggest image first, then by name
+int mark_duplicates(BATCH_IMAGE *, unsigned int); // Fails the images whose output, in any case, is the one of an image before them in the list, -1 if it could not check
+int compare_outputs(const void *, const void *); // Orders pointers to images by output in any case, then by place in the list
+void compress_task(void *, unsigned int, unsigned int); // Compresses the images [first, first + count) of a BATCH_JOB
+double elapsed(const struct timespec *); // Seconds since that instant
+
+int batch_compress(const char *input, const char *output, const BATCH_SETTINGS *settings, BATCH_REPORT *report)
+{
+	BATCH_JOB job;
+	struct stat st;
+	struct timespec start;
+	unsigned int count = 0;
+	int err = 0;
+	memset(report, 0, sizeof(BATCH_REPORT));
+	job.settings = settings;
+	job.pool = NULL;
+	job.images = NULL;
+	if(input != NULL && output != NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if(stat(input, &st) == 0 && S_ISDIR(st.st_mode))
+		{
+			count = list_directory(input, output, &job.images);
+		}
+		else
+		{
+			count = read_manifest(input, output, &job.images);
+		}
+		if(job.images != NULL)
+		{
+			qsort(job.images, count, sizeof(BATCH_IMAGE), compare_images);
+			// Two workers writing the same file would leave a mix of both images
+			err = mark_duplicates(job.images, count);
+			if(err == 0)
+			{
+				bmp_init_tables(); // Every thread reads them from now on
+				job.pool = (settings->threads != 1) ? thread_pool_create(settings->threads) : NULL;
+				// One image by task, the idle threads help with the block stages of the images still running
+				thread_pool_run(job.pool, compress_task, &job, count, 1);
+				thread_pool_destroy(&job.pool);
+			}
+			report->seconds = elapsed(&start);
+			report->images = count;
+			for(unsigned int i = 0; i < count; i++)
+			{
+				report->read_bytes += job.images[i].read_bytes;
+				report->written_bytes += job.images[i].written_bytes;
+				report->failed += job.images[i].failed;
+				free(job.images[i].input);
+				free(job.images[i].output);
+			}
+			free(job.images);
+		}
+		else if(ERROR == 0)
+		{
+			ERROR = ERR_COULD_NOT_OPEN_FILE;
+		}
+		if(job.images == NULL) err = -1;
+	}
+	else
+	{
+		ERROR = ERR_EMPTY_FILE_NAME;
+		err = -1;
+	}
+	error_catch(ERROR);
+	return err;
+}
+
+int add_image(BATCH_IMAGE **images, unsigned int *count, unsigned int *room, const char *input, const char *output)
+{
+	BATCH_IMAGE *grown = NULL;
+	const char *base = NULL, *slash = NULL, *dot = NULL;
+	struct stat st;
+	int err = 0;
+	if(*count == *room)
+	{
+		grown = (BATCH_IMAGE *) realloc(*images, (*room + FIRST_NAMES) * sizeof(BATCH_IMAGE));
+		if(grown != NULL)
+		{
+			*images = grown;
+			*room += FIRST_NAMES;
+		}
+	}
+	if(*count < *room)
+	{
+		// The output keeps the name of the input without its folder and extension
+		base = strrchr(input, '/');
+		slash = strrchr(input, '\\');
+		if(slash != NULL && (base == NULL || slash > base)) base = slash;
+		base = (base != NULL) ? (base + 1) : input;
+		dot = strrchr(base, '.');
+		if(dot == NULL) dot = base + strlen(base);
+		(*images)[*count].input = (char *) malloc(strlen(input) + 1);
+		(*images)[*count].output = (char *) malloc(strlen(output) + (dot - base) + 6);
+		if((*images)[*count].input != NULL && (*images)[*count].output != NULL)
+		{
+			strcpy((*images)[*count].input, input);
+			sprintf((*images)[*count].output, "%s/%.*s.cmp", output, (int) (dot - base), base);
+			// A missing input is counted as failed here, without trying to map it
+			(*images)[*count].failed = (stat(input, &st) == 0 && S_ISREG(st.st_mode)) ? 0 : 1;
+			(*images)[*count].read_bytes = ((*images)[*count].failed == 0) ? (unsigned long long) st.st_size : 0;
+			(*images)[*count].written_bytes = 0;
+			(*images)[*count].duplicate = 0;
+			(*count)++;
+		}
+		else
+		{
+			free((*images)[*count].input);
+			free((*images)[*count].output);
+			ERROR = ERR_ALLOCATE_MEMORY;
+			err = -1;
+		}
+	}
+	else
+	{
+		ERROR = ERR_ALLOCATE_MEMORY;
+		err = -1;
+	}
+	return err;
+}
+
+unsigned int list_directory(const char *directory, const char *output, BATCH_IMAGE **images)
+{
+	DIR *dir = opendir(directory);
+	struct dirent *entry = NULL;
+	char *path = NULL;
+	unsigned int count = 0, room = 0;
+	int err = 0;
+	if(dir != NULL)
+	{
+		*images = (BATCH_IMAGE *) malloc(FIRST_NAMES * sizeof(BATCH_IMAGE));
+		room = (*images != NULL) ? FIRST_NAMES : 0;
+		while(err == 0 && (entry = readdir(dir)) != NULL)
+		{
+			if(has_bmp_extension(entry->d_name) == 1)
+			{
+				path = (char *) malloc(strlen(directory) + strlen(entry->d_name) + 2);
+				if(path != NULL)
+				{
+					sprintf(path, "%s/%s", directory, entry->d_name);
+					err = add_image(images, &count, &room, path, output);
+					free(path);
+				}
+				else
+				{
+					ERROR = ERR_ALLOCATE_MEMORY;
+					err = -1;
+				}
+			}
+		}
+		closedir(dir);
+	}
+	return count;
+}
+
+unsigned int read_manifest(const char *manifest, const char *output, BATCH_IMAGE **images)
+{
+	FILE *arq = fopen(manifest, "r");
+	char line[MANIFEST_LINE];
+	size_t length = 0;
+	unsigned int count = 0, room = 0;
+	int err = 0;
+	if(arq != NULL)
+	{
+		*images = (BATCH_IMAGE *) malloc(FIRST_NAMES * sizeof(BATCH_IMAGE));
+		room = (*images != NULL) ? FIRST_NAMES : 0;
+		while(err == 0 && fgets(line, sizeof(line), arq) != NULL)
+		{
+			length = strlen(line);
+			while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' '))
+			{
+				line[--length] = '\0';
+			}
+			if(length > 0 && line[0] != '#')
+			{
+				err = add_image(images, &count, &room, line, output);
+			}
+		}
+		fclose(arq);
+	}
+	return count;
+}
+
+int has_bmp_extension(const char *name)
+{
+	size_t length = strlen(name);
+	int match = 0;
+	if(length > 4 && name[length - 4] == '.')
+	{
+		match = ((name[length - 3] | 0x20) == 'b' && (name[length - 2] | 0x20) == 'm' && (name[length - 1] | 0x20) == 'p') ? 1 : 0;
+	}
+	return match;
+}
+
+int compare_images(const void *a, const void *b)
+{
+	const BATCH_IMAGE *x = (const BATCH_IMAGE *) a, *y = (const BATCH_IMAGE *) b;
+	int order = 0;
+	if(x->read_bytes != y->read_bytes)
+	{
+		order = (x->read_bytes > y->read_bytes) ? -1 : 1;
+	}
+	else
+	{
+		order = strcmp(x->input, y->input);
+	}
+	return order;
+}
+
+int mark_duplicates(BATCH_IMAGE *images, unsigned int count)
+{
+	BATCH_IMAGE **order = (BATCH_IMAGE **) malloc((count + 1) * sizeof(BATCH_IMAGE *)), *kept = NULL;
+	int err = 0;
+	if(order != NULL)
+	{
+		for(unsigned int i = 0; i < count; i++)
+		{
+			order[i] = &images[i];
+		}
+		// The same names end up next to each other, the first one of the list leading them
+		qsort(order, count, sizeof(BATCH_IMAGE *), compare_outputs);
+		for(unsigned int i = 0; i < count; i++)
+		{
+			if(kept != NULL && strcasecmp(order[i]->output, kept->output) == 0)
+			{
+				printf("%s is skipped, %s is already the output of %s\n", order[i]->input, order[i]->output, kept->input);
+				order[i]->failed = 1;
+				order[i]->duplicate = 1;
+				order[i]->read_bytes = 0;
+			}
+			else
+			{
+				kept = order[i];
+			}
+		}
+		free(order);
+	}
+	else
+	{
+		ERROR = ERR_ALLOCATE_MEMORY;
+		err = -1;
+	}
+	return err;
+}
+
+int compare_outputs(const void *a, const void *b)
+{
+	const BATCH_IMAGE *x = *(const BATCH_IMAGE **) a, *y = *(const BATCH_IMAGE **) b;
+	int order = strcasecmp(x->output, y->output);
+	if(order == 0)
+	{
+		order = (x < y) ? -1 : ((x > y) ? 1 : 0);
+	}
+	return order;
+}
+
+void compress_task(void *arg, unsigned int first, unsigned int count)
+{
+	BATCH_JOB *job = (BATCH_JOB *) arg;
+	BATCH_IMAGE *image = NULL;
+	BMP_FILE *bmp = NULL;
+	struct stat st;
+	int status = -1;
+	for(unsigned int i = first; i < (first + count); i++)
+	{
+		image = &job->images[i];
+		ERROR = 0; // The error of an image is printed with it, it must not stick to the next one
+		status = -1;
+		if(image->duplicate == 0) remove(image->output); // A file left by an earlier run would pass for this one
+		bmp = (image->failed == 0) ? bmp_map_file(image->input) : NULL;
+		if(bmp != NULL)
+		{
+			bmp_set_dct_engine(bmp, job->settings->engine);
+			bmp_set_pool(bmp, job->pool);
+			bmp_set_format(bmp, job->settings->format);
+			bmp_set_predictor(bmp, job->settings->predictor);
+			bmp_set_segments(bmp, job->settings->segment_blocks);
+			bmp_set_index(bmp, job->settings->index_blocks);
+			bmp_dct(bmp, 0);
+			bmp_quantization(bmp);
+			bmp_diff_encode(bmp);
+			status = bmp_compress(bmp, image->output);
+			bmp_destroy(&bmp);
+		}
+		if(status == 0 && stat(image->output, &st) == 0)
+		{
+			image->written_bytes = (unsigned long long) st.st_size;
+		}
+		else
+		{
+			image->failed = 1;
+			if(image->duplicate == 0) remove(image->output); // Nothing half written is left behind
+		}
+	}
+	ERROR = 0;
+}
+
+double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - start->tv_sec) + ((double) (now.tv_nsec - start->tv_nsec) / 1e9);
+}
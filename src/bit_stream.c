@@ -0,0 +1,236 @@
+#include <bit_stream.h>
+#include <error_handler.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern _Thread_local unsigned int ERROR;
+
+int bit_writer_grow(BIT_WRITER *); // Doubles the buffer of a writer without file
+int bit_writer_room(BIT_WRITER *, size_t); // Makes room for more bytes in the buffer, flushing or growing it
+
+int bit_writer_open(BIT_WRITER *writer, FILE *arq, size_t capacity)
+{
+    int err = 0;
+    if(capacity == 0) capacity = BIT_WRITER_CAPACITY;
+    writer->size = 0;
+    writer->flushed = 0;
+    writer->arq = arq;
+    writer->accumulator = 0;
+    writer->bits = 0;
+    writer->data = (unsigned char *) malloc(capacity);
+    if(writer->data != NULL)
+    {
+        writer->capacity = capacity;
+    }
+    else
+    {
+        writer->capacity = 0;
+        ERROR = ERR_ALLOCATE_MEMORY;
+        err = -1;
+    }
+    return err;
+}
+
+int bit_writer_grow(BIT_WRITER *writer)
+{
+    int err = 0;
+    size_t capacity = (writer->capacity > 0) ? (writer->capacity * 2) : BIT_WRITER_CAPACITY;
+    unsigned char *data = (unsigned char *) realloc(writer->data, capacity);
+    if(data != NULL)
+    {
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    else
+    {
+        ERROR = ERR_ALLOCATE_MEMORY;
+        err = -1;
+    }
+    return err;
+}
+
+int bit_writer_room(BIT_WRITER *writer, size_t bytes)
+{
+    int err = 0;
+    if((writer->size + bytes) > writer->capacity)
+    {
+        if(writer->arq != NULL) err = bit_writer_flush(writer);
+        else err = bit_writer_grow(writer);
+    }
+    return err;
+}
+
+void bit_writer_word(BIT_WRITER *writer, unsigned long word)
+{
+    if(bit_writer_room(writer, sizeof(unsigned long)) == 0)
+    {
+        memcpy(writer->data + writer->size, &word, sizeof(unsigned long));
+        writer->size += sizeof(unsigned long);
+    }
+}
+
+void bit_writer_bits(BIT_WRITER *writer, unsigned int code, unsigned char length)
+{
+    writer->accumulator = (writer->accumulator << length) | code;
+    writer->bits += length;
+    if(writer->bits >= 32) // Sends 4 bytes at once, big endian
+    {
+        if(bit_writer_room(writer, 4) == 0)
+        {
+            writer->bits -= 32;
+            writer->data[writer->size++] = (unsigned char) (writer->accumulator >> (writer->bits + 24));
+            writer->data[writer->size++] = (unsigned char) (writer->accumulator >> (writer->bits + 16));
+            writer->data[writer->size++] = (unsigned char) (writer->accumulator >> (writer->bits + 8));
+            writer->data[writer->size++] = (unsigned char) (writer->accumulator >> writer->bits);
+        }
+    }
+}
+
+void bit_writer_align(BIT_WRITER *writer)
+{
+    if((writer->bits % 8) != 0)
+    {
+        writer->accumulator <<= 8 - (writer->bits % 8);
+        writer->bits += 8 - (writer->bits % 8);
+    }
+    if(bit_writer_room(writer, 4) == 0)
+    {
+        while(writer->bits > 0)
+        {
+            writer->bits -= 8;
+            writer->data[writer->size++] = (unsigned char) (writer->accumulator >> writer->bits);
+        }
+    }
+    writer->accumulator = 0;
+}
+
+void bit_writer_bytes(BIT_WRITER *writer, const unsigned char *data, size_t size)
+{
+    size_t part = 0;
+    bit_writer_align(writer);
+    while(size > 0)
+    {
+        if(writer->size == writer->capacity && bit_writer_room(writer, 1) != 0) break;
+        part = writer->capacity - writer->size;
+        if(part > size) part = size;
+        memcpy(writer->data + writer->size, data, part);
+        writer->size += part;
+        data += part;
+        size -= part;
+    }
+}
+
+size_t bit_writer_tell(const BIT_WRITER *writer)
+{
+    return ((writer->flushed + writer->size) * 8) + writer->bits;
+}
+
+int bit_writer_flush(BIT_WRITER *writer)
+{
+    int err = 0;
+    if(writer->arq != NULL && writer->size > 0)
+    {
+        if(fwrite(writer->data, 1, writer->size, writer->arq) != writer->size)
+        {
+            ERROR = ERR_CREATE_BITMAP;
+            err = -1;
+        }
+        writer->flushed += writer->size;
+        writer->size = 0;
+    }
+    return err;
+}
+
+unsigned char *bit_writer_swap(BIT_WRITER *writer, unsigned char *data, size_t capacity, size_t *size)
+{
+    unsigned char *full = writer->data;
+    // The bits still in the accumulator stay, they go out with the next bytes
+    *size = writer->size;
+    writer->flushed += writer->size;
+    writer->data = data;
+    writer->capacity = capacity;
+    writer->size = 0;
+    return full;
+}
+
+void bit_writer_close(BIT_WRITER *writer)
+{
+    bit_writer_align(writer);
+    bit_writer_flush(writer);
+    free(writer->data);
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+}
+
+int bit_reader_open(BIT_READER *reader, FILE *arq)
+{
+    int err = 0;
+    size_t capacity = BIT_WRITER_CAPACITY, read_bytes = 0;
+    unsigned char *data = NULL;
+    reader->size = 0;
+    reader->position = 0;
+    reader->window = 0;
+    reader->bits = 0;
+    reader->data = (unsigned char *) malloc(capacity + BIT_READER_PADDING);
+    while(reader->data != NULL)
+    {
+        read_bytes = fread(reader->data + reader->size, 1, capacity - reader->size, arq);
+        reader->size += read_bytes;
+        if(reader->size < capacity) // End of the file
+        {
+            break;
+        }
+        capacity *= 2;
+        data = (unsigned char *) realloc(reader->data, capacity + BIT_READER_PADDING);
+        if(data == NULL)
+        {
+            free(reader->data);
+        }
+        reader->data = data;
+    }
+    if(reader->data != NULL)
+    {
+        memset(reader->data + reader->size, 0, BIT_READER_PADDING);
+        bit_reader_fill(reader);
+    }
+    else
+    {
+        reader->size = 0;
+        ERROR = ERR_ALLOCATE_MEMORY;
+        err = -1;
+    }
+    return err;
+}
+
+unsigned long bit_reader_word(BIT_READER *reader)
+{
+    unsigned char bytes[8];
+    unsigned long word = reader->window >> 32;
+    bit_reader_skip(reader, 32);
+    word = (word << 32) | (reader->window >> 32);
+    bit_reader_skip(reader, 32);
+    for(int i = 0; i < 8; i++) // Bytes in the order of the stream
+    {
+        bytes[i] = (unsigned char) (word >> (56 - (i * 8)));
+    }
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+void bit_reader_seek(BIT_READER *reader, size_t bit)
+{
+    reader->position = bit / 8;
+    reader->window = 0;
+    reader->bits = 0;
+    bit_reader_fill(reader);
+    bit_reader_skip(reader, (unsigned char) (bit % 8));
+}
+
+void bit_reader_close(BIT_READER *reader)
+{
+    free(reader->data);
+    reader->data = NULL;
+    reader->size = 0;
+    reader->position = 0;
+}
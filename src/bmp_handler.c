@@ -1,21 +1,121 @@
 #include <bmp_handler.h>
+#include <bmp_simd.h>
+#include <bit_stream.h>
+#include <rans.h>
+#include <thread_pool.h>
+#include <ring_buffer.h>
+#include <container.h>
+#include <huffman.h>
 #include <error_handler.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+    #include <malloc.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 #define BMP_SIG 0x4D42 // Bitmap file identification
 #define SQRT_2 1.414214 // Calculated square root of 2
 #define EOB -3000 // End Of Block Macro
+#define BLOCK_BYTES 192 // Bytes of a 8x8 block in the BGR24 pixel array
+#define BAND_BLOCKS 4096 // Blocks read from the disk at once (768 KB)
+#define BLOCK_SIZE 64 // Coefficients of a 8x8 block
+#define ARENA_ALIGN 64 // Alignment of the channels memory (a cache line)
+#define BMP_HEADER_SIZE 54 // Size of the BMP file header plus BITMAPINFOHEADER
+#define HUFFMAN_RANGE 2047 // Largest magnitude with an entry in the Huffman table
+#define HUFFMAN_ENTRIES ((2 * HUFFMAN_RANGE) + 1) // Entries of the Huffman table, from -HUFFMAN_RANGE to HUFFMAN_RANGE
+#define LOOKAHEAD_BITS 12 // Bits peeked by the decoder, longer codes take the slow path
+#define EOB_CODE 0xFF // Huffman code of the EOB
+#define EOB_LENGTH 8 // Length of the Huffman code of the EOB
+#define STREAM_LIMIT 1023 // Largest magnitude the stream format can code, larger values are clamped
+#define DC_LIMIT 2047 // Largest DC magnitude of the (run, size) format (size 11), larger values are clamped
+#define AC_LIMIT 1023 // Largest AC magnitude of the (run, size) format (size 10), larger values are clamped
+#define SYMBOL_EOB 0x00 // (run, size) symbol closing a block, the rest of the coefficients are zero
+#define SYMBOL_ZRL 0xF0 // (run, size) symbol of a run of 16 zeros
+#define MAX_CODE_LENGTH 16 // Longest code of a symbol table
+#define MAX_TREE_LENGTH 32 // Longest code of an optimal tree, before it is limited to MAX_CODE_LENGTH
+#define RANS_EOB 11 // Symbol of the AC models of the rANS format closing a block, the others are the sizes 0 to 10
+#define SLICE_BATCH_BLOCKS 16384 // Blocks of the segments coded in parallel before they are written, bounds the memory of the buffers
+#define SLICES_BY_THREAD 4 // Least segments of a batch for each thread, to even out slow segments
+#define COUNT_CHUNKS_BY_THREAD 4 // Chunks of the symbol count of the optimized tables for each thread
+#define STREAM_BANDS_BY_WORKER 3 // Bands of bmp_compress_stream in flight for each transform thread, bounds the memory of the pipeline
+#define STREAM_CHUNKS 4 // Output buffers of bmp_compress_stream between the encoder and the writer thread
+#define STREAM_CHUNK_BYTES (1 << 17) // Size of those buffers, they go to the writer once half full
 
-// Structure used like a buffer to write in a file
-typedef struct t_buffer
+// Huffman code of a value, ready to be shifted into the buffer
+typedef struct t_huffman_entry
 {
-    unsigned long buffer; // Buffer size of 8 bytes long
-    unsigned char remaining_bits; // Quantity of free bits in buffer
-} BUFFER;
+    unsigned int code; // Code bits, right aligned
+    unsigned char length; // Quantity of bits of the code, 0 when the value can't be encoded
+} HUFFMAN_ENTRY;
 
-unsigned int ERROR = 0x00;
+// Symbol found by the decoder in the next LOOKAHEAD_BITS bits
+typedef struct t_huffman_symbol
+{
+    short value; // Decoded value or EOB
+    unsigned char length; // Bits to consume, 0 when the code is longer than LOOKAHEAD_BITS
+} HUFFMAN_SYMBOL;
+
+// Canonical Huffman table of the (run, size) symbols, laid out like a JPEG DHT segment
+typedef struct t_symbol_table
+{
+    unsigned char bits[MAX_CODE_LENGTH + 1]; // Quantity of codes of each length, from 1 to MAX_CODE_LENGTH (bits[0] is unused)
+    unsigned char values[256]; // Symbols sorted by code
+    HUFFMAN_ENTRY codes[256]; // Code of each symbol, length 0 when the symbol has no code
+    HUFFMAN_SYMBOL lookup[1 << LOOKAHEAD_BITS]; // Symbol of every LOOKAHEAD_BITS bits pattern, length 0 when the code is longer
+    int max_code[MAX_CODE_LENGTH + 2]; // Largest code of each length, -1 when there's none
+    int offset[MAX_CODE_LENGTH + 1]; // Index in values of the first code of each length, minus that code
+} SYMBOL_TABLE;
+
+// Adaptive models of the rANS format, one set for luminance and one for chrominance
+typedef struct t_rans_context
+{
+    RANS_MODEL dc[2]; // Size of the DC
+    RANS_MODEL ac[2][63]; // Size of the AC coefficient, or RANS_EOB, at each zig zag position
+} RANS_CONTEXT;
+
+// Batch of segments coded in parallel by encode_segments
+typedef struct t_slice_job
+{
+    BMP_FILE *bmp;
+    BIT_WRITER *slices; // One in-memory writer by segment of the batch
+    unsigned int first; // First segment of the batch
+    unsigned int count; // Segments in the batch
+    unsigned int *index; // Block offsets of the file, NULL without them
+} SLICE_JOB;
+
+// Run of blocks the decoder can start on its own, from the start of a segment or an entry of the block index
+typedef struct t_decode_unit
+{
+    unsigned int first; // First block of the run
+    unsigned int count; // Blocks in the run
+    size_t bit; // Where the run starts in the coded data
+} DECODE_UNIT;
+
+// Runs of blocks decoded in parallel by bmp_decompress_parallel
+typedef struct t_decode_job
+{
+    BMP_FILE *bmp;
+    const BIT_READER *in; // Coded data shared by every run, each one reads it with a copy of the reader
+    const DECODE_UNIT *units;
+} DECODE_JOB;
+
+// Symbol counts of optimize_tables, one set of 4 x 256 counts by chunk of blocks
+typedef struct t_count_job
+{
+    BMP_FILE *bmp;
+    unsigned long *freq;
+    unsigned int chunk; // Blocks by chunk
+} COUNT_JOB;
+
+_Thread_local unsigned int ERROR = 0x00; // Each thread has its own, thread_pool_run hands the errors of its helpers to the caller
 
 // Cosine table for fast DCT calculation
 const double COS[8][8] = { { 1.000000, 1.000000, 1.000000, 1.000000, 1.000000, 1.000000, 1.000000, 1.000000 },
@@ -27,6 +127,70 @@ const double COS[8][8] = { { 1.000000, 1.000000, 1.000000, 1.000000, 1.000000, 1
                            { 0.382683, -0.923880, 0.923880, -0.382683, -0.382683, 0.923880, -0.923880, 0.382683 },
                            { 0.195090, -0.555570, 0.831470, -0.980785, 0.980785, -0.831470, 0.555570, -0.195090 } };
 
+// Normalization factor of each DCT frequency (1 / sqrt(2) for the DC)
+const double C[8] = { 1.0 / SQRT_2, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0 };
+
+// Output scale factors of the AAN DCT, cos(k * pi / 16) * sqrt(2), except for k = 0
+const double AAN_SCALE[8] = { 1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379 };
+
+// Quantization tables of the fast engine, with the AAN scaling merged (built by init_aan_tables)
+double QUANT_LUMINANCE_AAN[64], QUANT_CHROMI_AAN[64]; // Reciprocals, used by the quantization
+double DEQUANT_LUMINANCE_AAN[64], DEQUANT_CHROMI_AAN[64]; // Multipliers, used by the inverse quantization
+
+// Huffman code of every value from -HUFFMAN_RANGE to HUFFMAN_RANGE (built by init_huffman_table)
+HUFFMAN_ENTRY HUFFMAN_TABLE[HUFFMAN_ENTRIES];
+
+// Symbol of every LOOKAHEAD_BITS bits pattern (built by init_huffman_table)
+HUFFMAN_SYMBOL DECODE_TABLE[1 << LOOKAHEAD_BITS];
+
+// Length of the Huffman code of each category, 0 for the categories without code
+const unsigned char CATEGORY_LENGTH[11] = { 3, 4, 5, 5, 7, 8, 10, 12, 14, 16, 18 };
+
+// Standard tables of the JPEG specification (Annex K.3), DC and AC of luminance and chrominance
+const unsigned char DC_LUMINANCE_BITS[MAX_CODE_LENGTH + 1] = { 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const unsigned char DC_CHROMI_BITS[MAX_CODE_LENGTH + 1] = { 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const unsigned char DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+const unsigned char AC_LUMINANCE_BITS[MAX_CODE_LENGTH + 1] = { 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D };
+const unsigned char AC_LUMINANCE_VALUES[162] = {    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+                                                    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+                                                    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+                                                    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+                                                    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+                                                    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+                                                    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+                                                    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+                                                    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+                                                    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+                                                    0xF9, 0xFA };
+const unsigned char AC_CHROMI_BITS[MAX_CODE_LENGTH + 1] = { 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const unsigned char AC_CHROMI_VALUES[162] = {   0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+                                                0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+                                                0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+                                                0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+                                                0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+                                                0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+                                                0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+                                                0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+                                                0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+                                                0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+                                                0xF9, 0xFA };
+
+// Tables of the (run, size) format, index 0 for luminance and 1 for chrominance (built by init_symbol_tables)
+SYMBOL_TABLE DC_TABLE[2], AC_TABLE[2];
+
+// Bits needed by the magnitude of each value up to DC_LIMIT, the size of the (run, size) symbols
+unsigned char MAGNITUDE_BITS[DC_LIMIT + 1];
+
+// Position in the block of each coefficient, in the zig zag order followed by write_in and read_of
+const unsigned char ZIGZAG[64] = {  0,  1,  8, 16,  9,  2,  3, 10,
+                                   17, 24, 32, 25, 18, 11,  4,  5,
+                                   12, 19, 26, 33, 40, 48, 41, 34,
+                                   27, 20, 13,  6,  7, 14, 21, 28,
+                                   35, 42, 49, 56, 57, 50, 43, 36,
+                                   29, 22, 15, 23, 30, 37, 44, 51,
+                                   58, 59, 52, 45, 38, 31, 39, 46,
+                                   53, 60, 61, 54, 47, 55, 62, 63 };
+
 // Quantization table used in luminance channel (Y)
 const unsigned char QUANT_LUMINANCE[8][8] = {   { 18.0, 14.0, 14.0, 21.0, 30.0, 35.0, 34.0, 39.0 },
                                                 { 14.0, 16.0, 16.0, 19.0, 26.0, 24.0, 30.0, 39.0 },
@@ -47,24 +211,72 @@ const unsigned char QUANT_CHROMI[8][8] = {  { 20.0, 19.0, 22.0, 27.0, 26.0, 33.0
                                             { 49.0, 45.0, 59.0, 65.0, 65.0, 65.0, 65.0, 65.0 },
                                             { 62.0, 56.0, 65.0, 65.0, 65.0, 65.0, 65.0, 65.0 } };
 
+int bmp_alloc_channels(BMP_FILE *); // Function to allocate the memory used by channels, -1 if it cannot
 void bmp_free_channels(BMP_FILE **); // Function to free memory used by channels
-void foward_dct(double **); // Calculates the foward DCT-II in 8x8 blocks
-void inverse_dct(double **); // Calculates the inverse DCT-II in 8x8 blocks
-void quantization_luminance(double **); // Apply the quantization in luminance channel
-void inverse_quantization_luminance(double **); // Apply the inverse quantization in luminance channel
-void quantization_chrominance(double **); // Apply the quantization in chrominance channel
-void inverse_quantization_chrominance(double **); // Apply the inverse quantization in chrominance channel
-void calculate_difference(double **); // Auxiliary function to delta encoding
-void calculate_inv_difference(double **); // Auxiliary function do delta decoding
-void print8x8block(double **); // Print the content of an 8x8 block
-int category(unsigned int); // Given then huffman code 'code', returns the category of the bit stream
-unsigned int huffman_code(int); // Returns the correspondent huffman code of value 'value'
-unsigned int inverse_huffman_code(unsigned int); // Calculates the inversed of huffman code
-void write_in(double **, FILE *); // Writes a 8x8 block in a file
-int fill_buffer(BUFFER *, int); // Function to fill 8 byte buffer
-unsigned long extract_value(unsigned long *); // Consume the buffer based in huffman code and computes his inverse
-void read_of(FILE *, double **); // Read the compressed file and recover the data
-void print_zigzag(double **); // Print a 2d array in a zig zag style
+void convert_band(const unsigned char *, BMP_FILE *, unsigned int, unsigned int); // Converts a band of BGR24 blocks to YCbCr
+void foward_dct(double *); // Calculates the foward DCT-II in 8x8 blocks, rows then columns
+void inverse_dct(double *); // Calculates the inverse DCT-II in 8x8 blocks, rows then columns
+void foward_dct_aan(double *); // Calculates the scaled foward DCT-II in 8x8 blocks with the AAN factorization
+void inverse_dct_aan(double *); // Calculates the inverse DCT-II of scaled coefficients with the AAN factorization
+void init_aan_tables(); // Merges the AAN output scaling into the quantization tables
+void init_simd_engines(); // Points the float and int16 engines to the kernels of the running CPU
+void quantization_scaled(double *, const double *); // Apply the quantization with a reciprocal table
+void inverse_quantization_scaled(double *, const double *); // Apply the inverse quantization with a multiplier table
+BMP_FILE *bmp_create(); // Allocates a BMP_FILE with the default settings
+void quantization_luminance(double *); // Apply the quantization in luminance channel
+void inverse_quantization_luminance(double *); // Apply the inverse quantization in luminance channel
+void quantization_chrominance(double *); // Apply the quantization in chrominance channel
+void inverse_quantization_chrominance(double *); // Apply the inverse quantization in chrominance channel
+void calculate_difference(double *); // Auxiliary function to delta encoding
+void calculate_inv_difference(double *); // Auxiliary function do delta decoding
+void foward_dct_task(void *, unsigned int, unsigned int); // Foward DCT-II of the blocks [first, first + count), the three channels swept as one
+void inverse_dct_task(void *, unsigned int, unsigned int); // Inverse DCT-II of the blocks [first, first + count), the three channels swept as one
+void quantization_task(void *, unsigned int, unsigned int); // Quantization of the blocks [first, first + count) of the three channels
+void inverse_quantization_task(void *, unsigned int, unsigned int); // Inverse quantization of the blocks [first, first + count) of the three channels
+void difference_task(void *, unsigned int, unsigned int); // Zig zag delta encoding of the blocks [first, first + count) of the three channels
+void inv_difference_task(void *, unsigned int, unsigned int); // Zig zag delta decoding of the blocks [first, first + count) of the three channels
+void predict_dc(double *, double *); // Replaces the DC of a block by its difference to the DC of the previous block of the channel
+void restore_dc(double *, double *); // Inverse of predict_dc
+void print8x8block(double *); // Print the content of an 8x8 block
+void fill_decode_table(unsigned int, unsigned char, int); // Points every pattern starting with 'code' to the value
+void write_in(double *, BIT_WRITER *); // Writes a 8x8 block in the output buffer
+void end_word(BUFFER *, BIT_WRITER *); // Closes the 8 byte buffer with the EOB prefix, sends it to the output and empties it
+int decode_symbol(unsigned long, unsigned char *); // Decodes the code at the top of the bits, returns its value, or EOB, and its length
+unsigned long extract_value(unsigned long *); // Consumes the next code of the buffer and returns its value, or EOB
+void read_of(BIT_READER *, double *); // Read the compressed words of a block and recover the data
+void put_value(BIT_WRITER *, int); // Appends the Huffman code of a value to the bitstream, clamped to STREAM_LIMIT
+void write_stream(double *, BIT_WRITER *); // Appends a 8x8 block to the continuous bitstream
+void read_stream(BIT_READER *, double *); // Decodes the next 8x8 block of the continuous bitstream
+void build_symbol_table(SYMBOL_TABLE *, const unsigned char *, const unsigned char *); // Assigns the canonical codes of a bits/values table and fills its lookup
+void init_symbol_tables(); // Builds the standard tables of the (run, size) format
+void put_symbol(BIT_WRITER *, const SYMBOL_TABLE *, unsigned char, int); // Appends the code of a (run, size) symbol followed by the value bits
+int get_symbol(BIT_READER *, const SYMBOL_TABLE *, int *); // Decodes the next (run, size) symbol and its value bits
+void write_run_size(double *, const SYMBOL_TABLE *, const SYMBOL_TABLE *, BIT_WRITER *); // Appends a 8x8 block as (run, size) symbols
+void read_run_size(BIT_READER *, const SYMBOL_TABLE *, const SYMBOL_TABLE *, double *); // Decodes the next 8x8 block of (run, size) symbols
+void count_run_size(double *, unsigned long *, unsigned long *); // Counts the (run, size) symbols of a 8x8 block, like write_run_size would write them
+void optimal_table(const unsigned long *, unsigned char *, unsigned char *); // Computes the bits/values of the optimal codes of 256 symbol counts, at most MAX_CODE_LENGTH bits long
+int optimize_tables(BMP_FILE *); // First pass of the optimized format, builds the tables from the symbol counts of the image, -1 if it fell back to FORMAT_RUN_SIZE
+void write_tables(const SYMBOL_TABLE *, BIT_WRITER *); // Appends the bits/values of the four optimized tables
+int read_tables(BIT_READER *, SYMBOL_TABLE *); // Reads and builds the four optimized tables, -1 if one of them can not be a canonical code
+void init_rans_context(RANS_CONTEXT *); // Starts every model of the rANS format
+void put_rans_value(RANS_ENCODER *, RANS_MODEL *, int, int); // Records the size of a value in the model, then its value bits
+int get_rans_value(RANS_DECODER *, RANS_MODEL *, int *); // Decodes a size and its value bits, returns the size
+void write_rans(double *, RANS_MODEL *, RANS_MODEL *, RANS_ENCODER *); // Records a 8x8 block with the models of its channel
+void read_rans(RANS_DECODER *, RANS_MODEL *, RANS_MODEL *, double *); // Decodes the next 8x8 block with the models of its channel
+int compress_rans(BMP_FILE *, unsigned int, unsigned int, BIT_WRITER *); // Codes the blocks [first, first + count) with new rANS models, writes the length of the coded data then the data
+int decompress_rans(BMP_FILE *, unsigned int, unsigned int, BIT_READER *); // Reads the length of the rANS data and decodes the blocks [first, first + count)
+void encode_blocks(BMP_FILE *, unsigned int, unsigned int, BIT_WRITER *); // Encodes the blocks [first, first + count) of the three channels in the format of the file
+void decode_blocks(BMP_FILE *, unsigned int, unsigned int, BIT_READER *); // Decodes the blocks [first, first + count) of the three channels from a bitstream
+unsigned int segment_count(const BMP_FILE *); // Quantity of segments of the coded data, 1 without segments
+unsigned int segment_length(const BMP_FILE *, unsigned int); // Blocks of a segment, the last one can be shorter
+void encode_segments(BMP_FILE *, unsigned int *, unsigned int *, BIT_WRITER *); // Encodes every segment byte aligned and records their offsets and the block offsets, in parallel when the file has threads
+void encode_segment(BMP_FILE *, unsigned int, unsigned int *, BIT_WRITER *); // Encodes the blocks of a segment, recording in the index where each run of index_blocks starts from the start of the segment
+void encode_slice_task(void *, unsigned int, unsigned int); // Encodes the segments [first, first + count) of a SLICE_JOB batch, each in its own buffer
+void count_task(void *, unsigned int, unsigned int); // Counts the (run, size) symbols of the blocks [first, first + count) in the counts of their chunk
+unsigned int *read_index(FILE *, unsigned int *, unsigned int); // Reads an index of a file written before the container and its blocks by entry, NULL if it does not cover that many blocks
+unsigned int index_count(unsigned int, unsigned int); // Entries of an index of the blocks given at that many blocks by entry
+void decode_unit_task(void *, unsigned int, unsigned int); // Decodes the runs [first, first + count) of a DECODE_JOB, each from its own position
+void print_zigzag(double *); // Print a 2d array in a zig zag style
 
 
 typedef struct t_bmp_info_header
@@ -95,25 +307,95 @@ typedef struct t_bmp_header
 struct t_bmp_channels
 {
     unsigned int qt_blocks;
-    double ***y, ***cb, ***cr;
+    double *y, *cb, *cr; // Blocks of 64 coefficients stored back to back, the three channels share one allocation
 };
 
 struct t_bmp_file
 {
     BMP_HEADER header;
     BMP_CHANNELS channels;
+    unsigned char dct_engine; // One of the DCT_* engines, the quantization must match the DCT used
+    unsigned short format; // One of the FORMAT_* layouts of the compressed data, stored in the container of the compressed file
+    unsigned short predictor; // One of the PREDICT_* delta encodings, stored in the container of the compressed file
+    SYMBOL_TABLE *tables; // Optimized tables, DC of luminance and chrominance then AC of both, NULL uses the standard ones
+    unsigned int segment_blocks; // Blocks of each independently decodable segment, 0 codes the image as one segment
+    unsigned int index_blocks; // Blocks between the entries of the block index, 0 writes no index
+    THREAD_POOL *pool; // Threads of the block stages, NULL runs them in the caller
+    unsigned char shared_pool; // Set when the pool belongs to the caller of bmp_set_pool, so the file does not destroy it
 };
 
+// Band of 8 rows of pixels on its way through the stages of bmp_compress_stream
+typedef struct t_stream_band
+{
+    unsigned char *pixels; // BGR24 pixels read from the file
+    BMP_FILE coefficients; // Blocks of the band, with the format and predictor of the file
+    unsigned int first; // First block of the band in the image
+    unsigned int blocks; // Blocks of the band, the last one can be shorter
+} STREAM_BAND;
+
+// Coded bytes on their way from the encoder to the writer thread
+typedef struct t_stream_chunk
+{
+    unsigned char *data;
+    size_t size; // Bytes to write
+    size_t capacity; // Bytes allocated for data
+} STREAM_CHUNK;
+
+// Stages of bmp_compress_stream and the rings between them, each ring has one producer and one consumer
+typedef struct t_stream_pipeline
+{
+    FILE *in;
+    FILE *out;
+    unsigned int qt_blocks; // Blocks of the image
+    unsigned int band_blocks; // Blocks of a full band
+    unsigned int workers; // Transform threads
+    RING_BUFFER *free_bands; // Encoder to reader, bands to be filled again
+    RING_BUFFER **read; // Reader to each worker, the band n goes to the worker n % workers, NULL stops the worker
+    RING_BUFFER **transformed; // Each worker to the encoder, popped in the same turn so the bands stay in order
+    RING_BUFFER *free_chunks; // Writer to encoder, chunks already written
+    RING_BUFFER *written; // Encoder to writer, NULL ends the data
+    unsigned int error; // Set by the writer when the disk fails, read once it is joined
+} STREAM_PIPELINE;
+
+// Argument of a transform thread
+typedef struct t_stream_worker
+{
+    STREAM_PIPELINE *pipeline;
+    unsigned int index; // Ring of the worker in read and transformed
+    pthread_t thread;
+} STREAM_WORKER;
+
+void *stream_reader(void *); // Reader stage of bmp_compress_stream, reads the bands in turn and deals them to the workers
+void *stream_worker(void *); // Transform stage of bmp_compress_stream, converts, transforms, quantizes and zig zag encodes the bands of one worker
+void *stream_writer(void *); // Writer stage of bmp_compress_stream, writes the chunks in the file until a NULL one
+void stream_encode(STREAM_PIPELINE *, BMP_FILE *, unsigned int *); // Encoder stage of bmp_compress_stream, run by the caller, codes the bands in order and hands the bytes to the writer
+void stream_chunk(STREAM_PIPELINE *, BIT_WRITER *); // Hands the bytes coded so far to the writer
+
+// DCT kernels of each engine, indexed by the engine (the SIMD ones are set by bmp_set_dct_engine)
+typedef void (*DCT_KERNEL)(double *);
+DCT_KERNEL FOWARD_DCT[] = { foward_dct, foward_dct_aan, NULL, NULL };
+DCT_KERNEL INVERSE_DCT[] = { inverse_dct, inverse_dct_aan, NULL, NULL };
+
+void parse_header(const unsigned char *, BMP_HEADER *); // Parse the 54 bytes header stored in memory
+void format_header(const BMP_HEADER *, unsigned char *); // Lays out the 54 bytes header in memory, the inverse of parse_header
+void write_header(FILE *, const BMP_HEADER *); // Writes the 54 bytes header in a file
+void fill_container(const BMP_FILE *, CONTAINER *, unsigned int *, unsigned int, unsigned int *, unsigned int); // Describes the compressed file of an image, its segments and its block index
+int read_container(FILE *, BMP_FILE *, unsigned int **, unsigned int **); // Reads the container of a compressed file into the image, its segments and its block index, -1 if it cannot be decoded
+int read_legacy(FILE *, BMP_FILE *, unsigned int **, unsigned int **); // Same for the files written before the container, described by the reserved fields of their BMP header
+int check_geometry(FILE *, unsigned int, unsigned int, unsigned short, unsigned long long, unsigned int *); // Sets the blocks of an image of that width and height, -1 if it does not fit in a BMP or the coded bytes left are too few for it
+
 BMP_FILE *bmp_read_file(const char *file_name)
 {
-    unsigned char r = 0x00, g = 0x00, b = 0x00;
+    unsigned char *band = NULL;
+    unsigned int band_blocks = 0;
+    size_t read_bytes = 0;
     BMP_FILE *bmp = NULL;
     if(file_name != NULL)
     {
         FILE *arq = fopen(file_name, "rb");
         if(arq != NULL)
         {
-            bmp = (BMP_FILE *) malloc(sizeof(BMP_FILE));
+            bmp = bmp_create();
             if(bmp != NULL)
             {
                 fread(&bmp->header.bmpSignature, sizeof(unsigned short), 1, arq);
@@ -136,43 +418,34 @@ BMP_FILE *bmp_read_file(const char *file_name)
                     fread(&bmp->header.info_header.bmpImportantColors, sizeof(unsigned int), 1, arq);
                     
                     bmp->channels.qt_blocks = (bmp->header.info_header.bmpHeight * bmp->header.info_header.bmpWidth) / 64;
-                    // Alloc pixels
-                    bmp->channels.y = (double ***) malloc(sizeof(double **) * bmp->channels.qt_blocks);
-                    bmp->channels.cb = (double ***) malloc(sizeof(double **) * bmp->channels.qt_blocks);
-                    bmp->channels.cr = (double ***) malloc(sizeof(double **) * bmp->channels.qt_blocks);
-                    for(int i = 0; i < bmp->channels.qt_blocks; i++)
-                    {
-                        bmp->channels.y[i] = (double **) malloc(sizeof(double *) * 8);
-                        bmp->channels.cb[i] = (double **) malloc(sizeof(double *) * 8);
-                        bmp->channels.cr[i] = (double **) malloc(sizeof(double *) * 8);
-                        for(int j = 0; j < 8; j++)
-                        {
-                            bmp->channels.y[i][j] = (double *) malloc(sizeof(double) * 8);
-                            bmp->channels.cb[i][j] = (double *) malloc(sizeof(double) * 8);
-                            bmp->channels.cr[i][j] = (double *) malloc(sizeof(double) * 8);
-                        }
-                    }
 
-                    // Read pixels
-                    fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
-                    for(int k = 0; k < bmp->channels.qt_blocks; k++)
+                    // Read pixels, a band of whole blocks per fread
+                    band = (unsigned char *) malloc(BAND_BLOCKS * BLOCK_BYTES);
+                    if(bmp_alloc_channels(bmp) == 0 && band != NULL)
                     {
-                        for(int i = 0; i < 8; i++)
+                        fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
+                        for(unsigned int k = 0; k < bmp->channels.qt_blocks; k += band_blocks)
                         {
-                            for(int j = 0; j < 8; j++)
+                            band_blocks = bmp->channels.qt_blocks - k;
+                            if(band_blocks > BAND_BLOCKS) band_blocks = BAND_BLOCKS;
+                            read_bytes = fread(band, 1, band_blocks * BLOCK_BYTES, arq);
+                            if(read_bytes < band_blocks * BLOCK_BYTES) // Short file, the missing pixels are black
                             {
-                                fread(&b, sizeof(unsigned char), 1, arq);
-                                fread(&g, sizeof(unsigned char), 1, arq);
-                                fread(&r, sizeof(unsigned char), 1, arq);
-                                bmp->channels.y[k][i][j] = (0.299 * r) + (0.587 * g) + (0.114 * b);
-                                bmp->channels.cb[k][i][j] = 0.564 * (b - bmp->channels.y[k][i][j]);
-                                bmp->channels.cr[k][i][j] = 0.713 * (r - bmp->channels.y[k][i][j]);
+                                memset(band + read_bytes, 0, (band_blocks * BLOCK_BYTES) - read_bytes);
                             }
+                            convert_band(band, bmp, k, band_blocks);
                         }
                     }
+                    else
+                    {
+                        bmp_destroy(&bmp); // Half an image would be compressed as if it was whole
+                        ERROR = ERR_ALLOCATE_MEMORY;
+                    }
+                    free(band);
                 }
                 else 
                 {
+                    bmp_destroy(&bmp);
                     ERROR = ERR_NOT_BITMAP;
                 }
             }
@@ -185,7 +458,7 @@ BMP_FILE *bmp_read_file(const char *file_name)
         {
             ERROR = ERR_COULD_NOT_OPEN_FILE;
         }
-        fclose(arq);
+        if(arq != NULL) fclose(arq);
     }
     else 
     {
@@ -195,9 +468,147 @@ BMP_FILE *bmp_read_file(const char *file_name)
     return bmp;
 }
 
+BMP_FILE *bmp_map_file(const char *file_name)
+{
+#ifdef _WIN32
+    return bmp_read_file(file_name);
+#else
+    int fd = -1;
+    struct stat st;
+    unsigned char *map = NULL, tail[BLOCK_BYTES];
+    unsigned int full_blocks = 0;
+    size_t pixel_bytes = 0;
+    BMP_FILE *bmp = NULL;
+    if(file_name != NULL)
+    {
+        fd = open(file_name, O_RDONLY);
+        if(fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= BMP_HEADER_SIZE)
+        {
+            map = (unsigned char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(map != MAP_FAILED)
+            {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                bmp = bmp_create();
+                if(bmp != NULL)
+                {
+                    parse_header(map, &bmp->header);
+                    if(bmp->header.bmpSignature == BMP_SIG) // Verify if it's a BMP file
+                    {
+                        bmp->channels.qt_blocks = (bmp->header.info_header.bmpHeight * bmp->header.info_header.bmpWidth) / 64;
+                        if(bmp_alloc_channels(bmp) == 0)
+                        {
+                            // Convert straight from the mapped pixels, only the blocks past the end of the file are staged
+                            if((off_t) bmp->header.bmpPixelDataOffset < st.st_size)
+                            {
+                                pixel_bytes = st.st_size - bmp->header.bmpPixelDataOffset;
+                            }
+                            full_blocks = pixel_bytes / BLOCK_BYTES;
+                            if(full_blocks > bmp->channels.qt_blocks) full_blocks = bmp->channels.qt_blocks;
+                            convert_band(map + bmp->header.bmpPixelDataOffset, bmp, 0, full_blocks);
+                            for(unsigned int k = full_blocks; k < bmp->channels.qt_blocks; k++) // Short file, the missing pixels are black
+                            {
+                                memset(tail, 0, BLOCK_BYTES);
+                                if(k == full_blocks)
+                                {
+                                    memcpy(tail, map + bmp->header.bmpPixelDataOffset + (full_blocks * BLOCK_BYTES), pixel_bytes - (full_blocks * BLOCK_BYTES));
+                                }
+                                convert_band(tail, bmp, k, 1);
+                            }
+                        }
+                        else
+                        {
+                            bmp_destroy(&bmp); // Half an image would be compressed as if it was whole
+                        }
+                    }
+                    else
+                    {
+                        bmp_destroy(&bmp);
+                        ERROR = ERR_NOT_BITMAP;
+                    }
+                }
+                else
+                {
+                    ERROR = ERR_ALLOCATE_MEMORY;
+                }
+                munmap(map, st.st_size);
+            }
+            else
+            {
+                ERROR = ERR_COULD_NOT_OPEN_FILE;
+            }
+        }
+        else
+        {
+            ERROR = ERR_COULD_NOT_OPEN_FILE;
+        }
+        if(fd >= 0) close(fd);
+    }
+    else
+    {
+        ERROR = ERR_EMPTY_FILE_NAME;
+    }
+    error_catch(ERROR);
+    return bmp;
+#endif
+}
+
+void parse_header(const unsigned char *data, BMP_HEADER *header)
+{
+    memcpy(&header->bmpSignature, data, sizeof(unsigned short));
+    memcpy(&header->bmpFileSize, data + 2, sizeof(unsigned int));
+    memcpy(&header->bmpReserverd1, data + 6, sizeof(unsigned short));
+    memcpy(&header->bmpReserverd2, data + 8, sizeof(unsigned short));
+    memcpy(&header->bmpPixelDataOffset, data + 10, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpHeaderSize, data + 14, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpWidth, data + 18, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpHeight, data + 22, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpPlanes, data + 26, sizeof(unsigned short));
+    memcpy(&header->info_header.bmpBitsPerPixel, data + 28, sizeof(unsigned short));
+    memcpy(&header->info_header.bmpCompression, data + 30, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpImageSize, data + 34, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpXPixelsPerMeter, data + 38, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpYPixelsPerMeter, data + 42, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpTotalColors, data + 46, sizeof(unsigned int));
+    memcpy(&header->info_header.bmpImportantColors, data + 50, sizeof(unsigned int));
+}
+
+void format_header(const BMP_HEADER *header, unsigned char *data)
+{
+    memcpy(data, &header->bmpSignature, sizeof(unsigned short));
+    memcpy(data + 2, &header->bmpFileSize, sizeof(unsigned int));
+    memcpy(data + 6, &header->bmpReserverd1, sizeof(unsigned short));
+    memcpy(data + 8, &header->bmpReserverd2, sizeof(unsigned short));
+    memcpy(data + 10, &header->bmpPixelDataOffset, sizeof(unsigned int));
+    memcpy(data + 14, &header->info_header.bmpHeaderSize, sizeof(unsigned int));
+    memcpy(data + 18, &header->info_header.bmpWidth, sizeof(unsigned int));
+    memcpy(data + 22, &header->info_header.bmpHeight, sizeof(unsigned int));
+    memcpy(data + 26, &header->info_header.bmpPlanes, sizeof(unsigned short));
+    memcpy(data + 28, &header->info_header.bmpBitsPerPixel, sizeof(unsigned short));
+    memcpy(data + 30, &header->info_header.bmpCompression, sizeof(unsigned int));
+    memcpy(data + 34, &header->info_header.bmpImageSize, sizeof(unsigned int));
+    memcpy(data + 38, &header->info_header.bmpXPixelsPerMeter, sizeof(unsigned int));
+    memcpy(data + 42, &header->info_header.bmpYPixelsPerMeter, sizeof(unsigned int));
+    memcpy(data + 46, &header->info_header.bmpTotalColors, sizeof(unsigned int));
+    memcpy(data + 50, &header->info_header.bmpImportantColors, sizeof(unsigned int));
+}
+
+void write_header(FILE *arq, const BMP_HEADER *header)
+{
+    unsigned char data[BMP_HEADER_SIZE];
+    format_header(header, data);
+    fwrite(data, 1, BMP_HEADER_SIZE, arq);
+}
+
+void convert_band(const unsigned char *band, BMP_FILE *bmp, unsigned int first_block, unsigned int qt_blocks)
+{
+    simd_kernels()->bgr_to_ycbcr(band, bmp->channels.y + (first_block * BLOCK_SIZE), bmp->channels.cb + (first_block * BLOCK_SIZE),
+                                 bmp->channels.cr + (first_block * BLOCK_SIZE), qt_blocks * BLOCK_SIZE);
+}
+
 int bmp_write_file(const char *file_name, BMP_FILE *bmp)
 {
-    unsigned char r = 0x00, g = 0x00, b = 0x00;
+    unsigned char *band = NULL;
+    unsigned int band_blocks = 0, first = 0;
     int err = 0;
     if(file_name != NULL)
     {
@@ -206,38 +617,28 @@ int bmp_write_file(const char *file_name, BMP_FILE *bmp)
             FILE *arq = fopen(file_name, "wb");
             if(arq != NULL)
             {
-                fwrite(&bmp->header.bmpSignature, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.bmpFileSize, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.bmpReserverd1, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.bmpReserverd2, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.bmpPixelDataOffset, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpHeaderSize, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpWidth, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpHeight, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpPlanes, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.info_header.bmpBitsPerPixel, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.info_header.bmpCompression, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpImageSize, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpXPixelsPerMeter, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpYPixelsPerMeter, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpTotalColors, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpImportantColors, sizeof(unsigned int), 1, arq);
+                write_header(arq, &bmp->header);
                 
-                fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
-                for(int k = 0; k < bmp->channels.qt_blocks; k++)
+                // Write pixels, a band of whole blocks per fwrite
+                band = (unsigned char *) malloc(BAND_BLOCKS * BLOCK_BYTES);
+                if(band != NULL)
                 {
-                    for(int i = 0; i < 8; i++)
+                    fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
+                    for(unsigned int k = 0; k < bmp->channels.qt_blocks; k += band_blocks)
                     {
-                        for(int j = 0; j < 8; j++)
-                        {
-                            r = (unsigned char) (bmp->channels.y[k][i][j] + (1.402 * bmp->channels.cr[k][i][j]));
-                            g = (unsigned char) (bmp->channels.y[k][i][j] - (0.344 * bmp->channels.cb[k][i][j]) - (0.714 * bmp->channels.cr[k][i][j]));
-                            b = (unsigned char) (bmp->channels.y[k][i][j] + (1.772 * bmp->channels.cb[k][i][j]));
-                            fwrite(&b, sizeof(unsigned char), 1, arq);
-                            fwrite(&g, sizeof(unsigned char), 1, arq);
-                            fwrite(&r, sizeof(unsigned char), 1, arq);
-                        }
+                        band_blocks = bmp->channels.qt_blocks - k;
+                        if(band_blocks > BAND_BLOCKS) band_blocks = BAND_BLOCKS;
+                        first = k * BLOCK_SIZE;
+                        // Values out of 0..255 are clamped, not wrapped around
+                        simd_kernels()->ycbcr_to_bgr(bmp->channels.y + first, bmp->channels.cb + first, bmp->channels.cr + first, band, band_blocks * BLOCK_SIZE);
+                        fwrite(band, 1, band_blocks * BLOCK_BYTES, arq);
                     }
+                    free(band);
+                }
+                else
+                {
+                    ERROR = ERR_ALLOCATE_MEMORY;
+                    err = -1;
                 }
             }
             else 
@@ -266,23 +667,14 @@ void bmp_dct(BMP_FILE *bmp, char type)
 {
     if(bmp != NULL)
     {
+        // The three channels are contiguous, so all the blocks are swept in one pass
         if(type == 0) // If it is the foward DCT-II
         {
-            for(int i = 0; i < bmp->channels.qt_blocks; i++)
-            {
-                foward_dct(bmp->channels.y[i]);
-                foward_dct(bmp->channels.cb[i]);
-                foward_dct(bmp->channels.cr[i]);
-            }
+            thread_pool_run(bmp->pool, foward_dct_task, bmp, 3 * bmp->channels.qt_blocks, 0);
         }
         else if(type == -1) // If it is the inversed DCT-II
         {
-            for(int i = 0; i < bmp->channels.qt_blocks; i++)
-            {
-                inverse_dct(bmp->channels.y[i]);
-                inverse_dct(bmp->channels.cb[i]);
-                inverse_dct(bmp->channels.cr[i]);
-            }
+            thread_pool_run(bmp->pool, inverse_dct_task, bmp, 3 * bmp->channels.qt_blocks, 0);
         }
     }
     else 
@@ -292,41 +684,110 @@ void bmp_dct(BMP_FILE *bmp, char type)
     error_catch(ERROR);
 }
 
-void foward_dct(double **channel)
+void foward_dct_task(void *arg, unsigned int first, unsigned int count)
 {
-    double sum = 0.0, ci = 0.0, cj = 0.0;
-    double out[8][8];
-    for(int i = 0; i < 8; i++)
+    BMP_FILE *bmp = (BMP_FILE *) arg;
+    double *end = bmp->channels.y + ((first + count) * BLOCK_SIZE);
+    for(double *block = bmp->channels.y + (first * BLOCK_SIZE); block < end; block += BLOCK_SIZE)
+    {
+        FOWARD_DCT[bmp->dct_engine](block);
+    }
+}
+
+void inverse_dct_task(void *arg, unsigned int first, unsigned int count)
+{
+    BMP_FILE *bmp = (BMP_FILE *) arg;
+    double *end = bmp->channels.y + ((first + count) * BLOCK_SIZE);
+    for(double *block = bmp->channels.y + (first * BLOCK_SIZE); block < end; block += BLOCK_SIZE)
+    {
+        INVERSE_DCT[bmp->dct_engine](block);
+    }
+}
+
+void bmp_set_threads(BMP_FILE *bmp, unsigned int threads)
+{
+    if(bmp != NULL)
+    {
+        if(bmp->shared_pool == 0) thread_pool_destroy(&bmp->pool);
+        bmp->pool = (threads != 1) ? thread_pool_create(threads) : NULL;
+        bmp->shared_pool = 0;
+    }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+}
+
+void bmp_set_pool(BMP_FILE *bmp, THREAD_POOL *pool)
+{
+    if(bmp != NULL)
+    {
+        if(bmp->shared_pool == 0) thread_pool_destroy(&bmp->pool);
+        bmp->pool = pool;
+        bmp->shared_pool = 1;
+    }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+}
+
+void foward_dct(double *channel)
+{
+    double sum = 0.0;
+    double tmp[8][8];
+
+    // 1-D DCT of the rows
+    for(int x = 0; x < 8; x++)
     {
         for(int j = 0; j < 8; j++)
         {
             sum = 0.0;
-            for(int x = 0; x < 8; x++)
+            for(int y = 0; y < 8; y++)
             {
-                for(int y = 0; y < 8; y++)
-                {
-                    sum += channel[x][y] * COS[i][x] * COS[j][y];
-                }
+                sum += channel[(x * 8) + y] * COS[j][y];
             }
-            if(i == 0) ci = (1.0 / SQRT_2); else ci = 1;
-            if(j == 0) cj = (1.0 / SQRT_2); else cj = 1;
-            out[i][j] = (1.0 / 4.0) * ci * cj * sum;
+            tmp[x][j] = sum;
         }
     }
 
+    // 1-D DCT of the columns
     for(int i = 0; i < 8; i++)
     {
         for(int j = 0; j < 8; j++)
         {
-            channel[i][j] = out[i][j];
+            sum = 0.0;
+            for(int x = 0; x < 8; x++)
+            {
+                sum += COS[i][x] * tmp[x][j];
+            }
+            channel[(i * 8) + j] = (1.0 / 4.0) * C[i] * C[j] * sum;
         }
     }
 }
 
-void inverse_dct(double **channel)
+void inverse_dct(double *channel)
 {
-    double out[8][8];
-    double sum = 0.0, ci = 0.0, cj = 0.0;
+    double sum = 0.0;
+    double tmp[8][8];
+
+    // 1-D inverse DCT of the rows
+    for(int i = 0; i < 8; i++)
+    {
+        for(int y = 0; y < 8; y++)
+        {
+            sum = 0.0;
+            for(int j = 0; j < 8; j++)
+            {
+                sum += C[j] * channel[(i * 8) + j] * COS[j][y];
+            }
+            tmp[i][y] = sum;
+        }
+    }
+
+    // 1-D inverse DCT of the columns
     for(int x = 0; x < 8; x++)
     {
         for(int y = 0; y < 8; y++)
@@ -334,37 +795,197 @@ void inverse_dct(double **channel)
             sum = 0.0;
             for(int i = 0; i < 8; i++)
             {
-                if(i == 0) ci = (1.0 / SQRT_2); else ci = 1;
-                for(int j = 0; j < 8; j++)
-                {
-                    if(j == 0) cj = (1.0 / SQRT_2); else cj = 1;
-                    sum += ci * cj * channel[i][j] * COS[i][x] * COS[j][y];
-                }
+                sum += C[i] * COS[i][x] * tmp[i][y];
             }
-            out[x][y] = (1.0 / 4.0) * sum;
+            channel[(x * 8) + y] = (1.0 / 4.0) * sum;
         }
     }
+}
 
-    for(int i = 0; i < 8; i++)
+void foward_dct_aan(double *channel)
+{
+    double tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    double tmp10, tmp11, tmp12, tmp13, z1, z2, z3, z4, z5, z11, z13;
+    double *d = NULL;
+
+    // Rows and then columns, the same butterflies with a different stride
+    for(int pass = 0, stride = 1, step = 8; pass < 2; pass++, stride = 8, step = 1)
+    {
+        for(int k = 0; k < 8; k++)
+        {
+            d = channel + (k * step);
+            tmp0 = d[0] + d[7 * stride];
+            tmp7 = d[0] - d[7 * stride];
+            tmp1 = d[stride] + d[6 * stride];
+            tmp6 = d[stride] - d[6 * stride];
+            tmp2 = d[2 * stride] + d[5 * stride];
+            tmp5 = d[2 * stride] - d[5 * stride];
+            tmp3 = d[3 * stride] + d[4 * stride];
+            tmp4 = d[3 * stride] - d[4 * stride];
+
+            // Even part
+            tmp10 = tmp0 + tmp3;
+            tmp13 = tmp0 - tmp3;
+            tmp11 = tmp1 + tmp2;
+            tmp12 = tmp1 - tmp2;
+            d[0] = tmp10 + tmp11;
+            d[4 * stride] = tmp10 - tmp11;
+            z1 = (tmp12 + tmp13) * 0.707106781;
+            d[2 * stride] = tmp13 + z1;
+            d[6 * stride] = tmp13 - z1;
+
+            // Odd part
+            tmp10 = tmp4 + tmp5;
+            tmp11 = tmp5 + tmp6;
+            tmp12 = tmp6 + tmp7;
+            z5 = (tmp10 - tmp12) * 0.382683433;
+            z2 = (0.541196100 * tmp10) + z5;
+            z4 = (1.306562965 * tmp12) + z5;
+            z3 = tmp11 * 0.707106781;
+            z11 = tmp7 + z3;
+            z13 = tmp7 - z3;
+            d[5 * stride] = z13 + z2;
+            d[3 * stride] = z13 - z2;
+            d[stride] = z11 + z4;
+            d[7 * stride] = z11 - z4;
+        }
+    }
+}
+
+void inverse_dct_aan(double *channel)
+{
+    double tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+    double tmp10, tmp11, tmp12, tmp13, z5, z10, z11, z12, z13;
+    double *d = NULL;
+
+    // Columns and then rows, the input was already scaled by the inverse quantization
+    for(int pass = 0, stride = 8, step = 1; pass < 2; pass++, stride = 1, step = 8)
     {
-        for(int j = 0; j < 8; j++)
+        for(int k = 0; k < 8; k++)
         {
-            channel[i][j] = out[i][j];
+            d = channel + (k * step);
+
+            // Even part
+            tmp0 = d[0];
+            tmp1 = d[2 * stride];
+            tmp2 = d[4 * stride];
+            tmp3 = d[6 * stride];
+            tmp10 = tmp0 + tmp2;
+            tmp11 = tmp0 - tmp2;
+            tmp13 = tmp1 + tmp3;
+            tmp12 = ((tmp1 - tmp3) * 1.414213562) - tmp13;
+            tmp0 = tmp10 + tmp13;
+            tmp3 = tmp10 - tmp13;
+            tmp1 = tmp11 + tmp12;
+            tmp2 = tmp11 - tmp12;
+
+            // Odd part
+            tmp4 = d[stride];
+            tmp5 = d[3 * stride];
+            tmp6 = d[5 * stride];
+            tmp7 = d[7 * stride];
+            z13 = tmp6 + tmp5;
+            z10 = tmp6 - tmp5;
+            z11 = tmp4 + tmp7;
+            z12 = tmp4 - tmp7;
+            tmp7 = z11 + z13;
+            tmp11 = (z11 - z13) * 1.414213562;
+            z5 = (z10 + z12) * 1.847759065;
+            tmp10 = (1.082392200 * z12) - z5;
+            tmp12 = (-2.613125930 * z10) + z5;
+            tmp6 = tmp12 - tmp7;
+            tmp5 = tmp11 - tmp6;
+            tmp4 = tmp10 + tmp5;
+
+            d[0] = tmp0 + tmp7;
+            d[7 * stride] = tmp0 - tmp7;
+            d[stride] = tmp1 + tmp6;
+            d[6 * stride] = tmp1 - tmp6;
+            d[2 * stride] = tmp2 + tmp5;
+            d[5 * stride] = tmp2 - tmp5;
+            d[4 * stride] = tmp3 + tmp4;
+            d[3 * stride] = tmp3 - tmp4;
         }
     }
 }
 
-void bmp_quantization(BMP_FILE *bmp)
+void init_aan_tables()
+{
+    static int ready = 0;
+    double scale = 0.0;
+    if(ready == 0)
+    {
+        for(int i = 0; i < 8; i++)
+        {
+            for(int j = 0; j < 8; j++)
+            {
+                // The foward AAN outputs are 8 times the DCT-II times the scale of the row and of the column
+                scale = AAN_SCALE[i] * AAN_SCALE[j];
+                QUANT_LUMINANCE_AAN[(i * 8) + j] = 1.0 / (QUANT_LUMINANCE[i][j] * scale * 8.0);
+                QUANT_CHROMI_AAN[(i * 8) + j] = 1.0 / (QUANT_CHROMI[i][j] * scale * 8.0);
+                // The inverse AAN expects the coefficients multiplied by the same scale, and outputs 8 times the pixels
+                DEQUANT_LUMINANCE_AAN[(i * 8) + j] = (QUANT_LUMINANCE[i][j] * scale) / 8.0;
+                DEQUANT_CHROMI_AAN[(i * 8) + j] = (QUANT_CHROMI[i][j] * scale) / 8.0;
+            }
+        }
+        ready = 1;
+    }
+}
+
+void init_simd_engines()
+{
+    const SIMD_KERNELS *kernels = NULL;
+    // The kernels for the running CPU are chosen once, the first time they are needed
+    if(FOWARD_DCT[DCT_FLOAT] == NULL)
+    {
+        kernels = simd_kernels();
+        FOWARD_DCT[DCT_FLOAT] = kernels->foward_dct_float;
+        INVERSE_DCT[DCT_FLOAT] = kernels->inverse_dct_float;
+        FOWARD_DCT[DCT_INT16] = kernels->foward_dct_int16;
+        INVERSE_DCT[DCT_INT16] = kernels->inverse_dct_int16;
+    }
+}
+
+void bmp_init_tables()
+{
+    init_aan_tables();
+    init_simd_engines();
+    init_huffman_table();
+    init_symbol_tables();
+}
+
+void bmp_set_dct_engine(BMP_FILE *bmp, unsigned char engine)
 {
     if(bmp != NULL)
     {
-        for(int i = 0; i < bmp->channels.qt_blocks; i++)
+        if(engine == DCT_FAST)
+        {
+            init_aan_tables();
+            bmp->dct_engine = DCT_FAST;
+        }
+        else if(engine == DCT_FLOAT || engine == DCT_INT16)
+        {
+            init_simd_engines();
+            bmp->dct_engine = engine;
+        }
+        else
         {
-            quantization_luminance(bmp->channels.y[i]);
-            quantization_chrominance(bmp->channels.cb[i]);
-            quantization_chrominance(bmp->channels.cr[i]);
+            bmp->dct_engine = DCT_REFERENCE;
         }
     }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+}
+
+void bmp_quantization(BMP_FILE *bmp)
+{
+    if(bmp != NULL)
+    {
+        thread_pool_run(bmp->pool, quantization_task, bmp, bmp->channels.qt_blocks, 0);
+    }
     else 
     {
         ERROR = ERR_BMP_NOT_EXIST;
@@ -372,46 +993,85 @@ void bmp_quantization(BMP_FILE *bmp)
     error_catch(ERROR);
 }
 
-void quantization_luminance(double **channel)
+void quantization_task(void *arg, unsigned int first, unsigned int count)
+{
+    BMP_FILE *bmp = (BMP_FILE *) arg;
+    if(bmp->dct_engine == DCT_FAST)
+    {
+        for(unsigned int i = first; i < (first + count); i++)
+        {
+            quantization_scaled(bmp->channels.y + (i * BLOCK_SIZE), QUANT_LUMINANCE_AAN);
+            quantization_scaled(bmp->channels.cb + (i * BLOCK_SIZE), QUANT_CHROMI_AAN);
+            quantization_scaled(bmp->channels.cr + (i * BLOCK_SIZE), QUANT_CHROMI_AAN);
+        }
+    }
+    else
+    {
+        for(unsigned int i = first; i < (first + count); i++)
+        {
+            quantization_luminance(bmp->channels.y + (i * BLOCK_SIZE));
+            quantization_chrominance(bmp->channels.cb + (i * BLOCK_SIZE));
+            quantization_chrominance(bmp->channels.cr + (i * BLOCK_SIZE));
+        }
+    }
+}
+
+void quantization_scaled(double *channel, const double *table)
+{
+    for(int k = 0; k < BLOCK_SIZE; k++)
+    {
+        channel[k] = round(channel[k] * table[k]);
+    }
+}
+
+void inverse_quantization_scaled(double *channel, const double *table)
+{
+    for(int k = 0; k < BLOCK_SIZE; k++)
+    {
+        channel[k] *= table[k];
+    }
+}
+
+void quantization_luminance(double *channel)
 {
     for(int i = 0; i < 8; i++)
     {
         for(int j = 0; j < 8; j++)
         {
-            channel[i][j] = round(channel[i][j] / QUANT_LUMINANCE[i][j]);
+            channel[(i * 8) + j] = round(channel[(i * 8) + j] / QUANT_LUMINANCE[i][j]);
         }
     }
 }
 
-void quantization_chrominance(double **channel)
+void quantization_chrominance(double *channel)
 {
     for(int i = 0; i < 8; i++)
     {
         for(int j = 0; j < 8; j++)
         {
-            channel[i][j] = round(channel[i][j] / QUANT_CHROMI[i][j]);
+            channel[(i * 8) + j] = round(channel[(i * 8) + j] / QUANT_CHROMI[i][j]);
         }
     }
 }
 
-void inverse_quantization_luminance(double **channel)
+void inverse_quantization_luminance(double *channel)
 {
     for(int i = 0; i < 8; i++)
     {
         for(int j = 0; j < 8; j++)
         {
-            channel[i][j] *= QUANT_LUMINANCE[i][j];
+            channel[(i * 8) + j] *= QUANT_LUMINANCE[i][j];
         }
     }
 }
 
-void inverse_quantization_chrominance(double **channel)
+void inverse_quantization_chrominance(double *channel)
 {
     for(int i = 0; i < 8; i++)
     {
         for(int j = 0; j < 8; j++)
         {
-            channel[i][j] *= QUANT_CHROMI[i][j];
+            channel[(i * 8) + j] *= QUANT_CHROMI[i][j];
         }
     }
 }
@@ -420,12 +1080,7 @@ void bmp_inverse_quantization(BMP_FILE *bmp)
 {
     if(bmp != NULL)
     {
-        for(int i = 0; i < bmp->channels.qt_blocks; i++)
-        {
-            inverse_quantization_luminance(bmp->channels.y[i]);
-            inverse_quantization_chrominance(bmp->channels.cb[i]);
-            inverse_quantization_chrominance(bmp->channels.cr[i]);
-        }
+        thread_pool_run(bmp->pool, inverse_quantization_task, bmp, bmp->channels.qt_blocks, 0);
     }
     else 
     {
@@ -434,29 +1089,46 @@ void bmp_inverse_quantization(BMP_FILE *bmp)
     error_catch(ERROR);
 }
 
-void print8x8block(double **channel)
+void inverse_quantization_task(void *arg, unsigned int first, unsigned int count)
+{
+    BMP_FILE *bmp = (BMP_FILE *) arg;
+    if(bmp->dct_engine == DCT_FAST)
+    {
+        for(unsigned int i = first; i < (first + count); i++)
+        {
+            inverse_quantization_scaled(bmp->channels.y + (i * BLOCK_SIZE), DEQUANT_LUMINANCE_AAN);
+            inverse_quantization_scaled(bmp->channels.cb + (i * BLOCK_SIZE), DEQUANT_CHROMI_AAN);
+            inverse_quantization_scaled(bmp->channels.cr + (i * BLOCK_SIZE), DEQUANT_CHROMI_AAN);
+        }
+    }
+    else
+    {
+        for(unsigned int i = first; i < (first + count); i++)
+        {
+            inverse_quantization_luminance(bmp->channels.y + (i * BLOCK_SIZE));
+            inverse_quantization_chrominance(bmp->channels.cb + (i * BLOCK_SIZE));
+            inverse_quantization_chrominance(bmp->channels.cr + (i * BLOCK_SIZE));
+        }
+    }
+}
+
+void print8x8block(double *channel)
 {
     for(int x = 0; x < 8; x++)
     {
         for(int y = 0; y < 8; y++)
         {
-            printf("%8.1lf", channel[x][y]);
+            printf("%8.1lf", channel[(x * 8) + y]);
         }
         printf("\n");
     }
 }
 
-void bmp_diff_encode(BMP_FILE *bmp)
+void bmp_set_predictor(BMP_FILE *bmp, unsigned short predictor)
 {
     if(bmp != NULL)
     {
-        for(int i = 0; i < bmp->channels.qt_blocks; i++)
-        {
-            calculate_difference(bmp->channels.y[i]);
-            calculate_difference(bmp->channels.cb[i]);
-            calculate_difference(bmp->channels.cr[i]);
-        }
-        // print_zigzag(bmp->channels.y[0]);
+        bmp->predictor = (predictor == PREDICT_DC) ? PREDICT_DC : PREDICT_ZIGZAG;
     }
     else
     {
@@ -465,17 +1137,11 @@ void bmp_diff_encode(BMP_FILE *bmp)
     error_catch(ERROR);
 }
 
-void bmp_diff_decode(BMP_FILE *bmp)
+void bmp_set_segments(BMP_FILE *bmp, unsigned int segment_blocks)
 {
-    int i = 0, j = 0, x = 0, y = 0;
     if(bmp != NULL)
     {
-        for(int i = 0; i < bmp->channels.qt_blocks; i++)
-        {
-            calculate_inv_difference(bmp->channels.y[i]);
-            calculate_inv_difference(bmp->channels.cb[i]);
-            calculate_inv_difference(bmp->channels.cr[i]);
-        }
+        bmp->segment_blocks = segment_blocks;
     }
     else
     {
@@ -484,18 +1150,127 @@ void bmp_diff_decode(BMP_FILE *bmp)
     error_catch(ERROR);
 }
 
-void calculate_difference(double **channel)
+void bmp_set_index(BMP_FILE *bmp, unsigned int index_blocks)
 {
-    int x = 0, y = 1, max = 2;
-    double current = 0.0, last = channel[0][0];
-
-    // First half
-    for(int i = 1; i < 8; i++, max++)
+    if(bmp != NULL)
+    {
+        bmp->index_blocks = index_blocks;
+    }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+}
+
+void bmp_diff_encode(BMP_FILE *bmp)
+{
+    double last[3] = { 0.0, 0.0, 0.0 }; // DC of the previous block of each channel
+    if(bmp != NULL)
+    {
+        if(bmp->predictor == PREDICT_DC) // Every DC depends on the previous one, so this pass stays in one thread
+        {
+            for(unsigned int i = 0; i < bmp->channels.qt_blocks; i++)
+            {
+                if(bmp->segment_blocks > 0 && (i % bmp->segment_blocks) == 0) // A segment starts from zero, like the first block
+                {
+                    last[0] = last[1] = last[2] = 0.0;
+                }
+                predict_dc(bmp->channels.y + (i * BLOCK_SIZE), &last[0]);
+                predict_dc(bmp->channels.cb + (i * BLOCK_SIZE), &last[1]);
+                predict_dc(bmp->channels.cr + (i * BLOCK_SIZE), &last[2]);
+            }
+        }
+        else
+        {
+            thread_pool_run(bmp->pool, difference_task, bmp, bmp->channels.qt_blocks, 0);
+        }
+        // print_zigzag(bmp->channels.y + (0 * BLOCK_SIZE));
+    }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+}
+
+void difference_task(void *arg, unsigned int first, unsigned int count)
+{
+    BMP_FILE *bmp = (BMP_FILE *) arg;
+    for(unsigned int i = first; i < (first + count); i++)
+    {
+        calculate_difference(bmp->channels.y + (i * BLOCK_SIZE));
+        calculate_difference(bmp->channels.cb + (i * BLOCK_SIZE));
+        calculate_difference(bmp->channels.cr + (i * BLOCK_SIZE));
+    }
+}
+
+void bmp_diff_decode(BMP_FILE *bmp)
+{
+    double last[3] = { 0.0, 0.0, 0.0 }; // DC of the previous block of each channel
+    if(bmp != NULL)
+    {
+        if(bmp->predictor == PREDICT_DC)
+        {
+            for(unsigned int i = 0; i < bmp->channels.qt_blocks; i++)
+            {
+                if(bmp->segment_blocks > 0 && (i % bmp->segment_blocks) == 0) // A segment starts from zero, like the first block
+                {
+                    last[0] = last[1] = last[2] = 0.0;
+                }
+                restore_dc(bmp->channels.y + (i * BLOCK_SIZE), &last[0]);
+                restore_dc(bmp->channels.cb + (i * BLOCK_SIZE), &last[1]);
+                restore_dc(bmp->channels.cr + (i * BLOCK_SIZE), &last[2]);
+            }
+        }
+        else
+        {
+            thread_pool_run(bmp->pool, inv_difference_task, bmp, bmp->channels.qt_blocks, 0);
+        }
+    }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+}
+
+void inv_difference_task(void *arg, unsigned int first, unsigned int count)
+{
+    BMP_FILE *bmp = (BMP_FILE *) arg;
+    for(unsigned int i = first; i < (first + count); i++)
+    {
+        calculate_inv_difference(bmp->channels.y + (i * BLOCK_SIZE));
+        calculate_inv_difference(bmp->channels.cb + (i * BLOCK_SIZE));
+        calculate_inv_difference(bmp->channels.cr + (i * BLOCK_SIZE));
+    }
+}
+
+void predict_dc(double *block, double *last)
+{
+    double current = block[0];
+    block[0] = current - (*last);
+    *last = current;
+}
+
+void restore_dc(double *block, double *last)
+{
+    block[0] += *last;
+    *last = block[0];
+}
+
+void calculate_difference(double *channel)
+{
+    int x = 0, y = 1, max = 2;
+    double current = 0.0, last = channel[(0 * 8) + 0];
+
+    // First half
+    for(int i = 1; i < 8; i++, max++)
     {
         for(int j = 1; j < max; j++)
         {
-            current = channel[x][y];
-            channel[x][y] = current - last;
+            current = channel[(x * 8) + y];
+            channel[(x * 8) + y] = current - last;
             last = current;
             if((i % 2) == 0)
             {
@@ -510,8 +1285,8 @@ void calculate_difference(double **channel)
 
         }
         
-        current = channel[x][y];
-        channel[x][y] = current - last;
+        current = channel[(x * 8) + y];
+        channel[(x * 8) + y] = current - last;
         last = current;
         if((i % 2) == 0)
         {
@@ -530,8 +1305,8 @@ void calculate_difference(double **channel)
     {
         for(int j = 0; j < max; j++)
         {
-            current = channel[x][y];
-            channel[x][y] = current - last;
+            current = channel[(x * 8) + y];
+            channel[(x * 8) + y] = current - last;
             last = current;
             if((i % 2) == 0)
             {
@@ -544,8 +1319,8 @@ void calculate_difference(double **channel)
                 y++;
             }
         }
-        current = channel[x][y];
-        channel[x][y] = current - last;
+        current = channel[(x * 8) + y];
+        channel[(x * 8) + y] = current - last;
         last = current;
         if((i % 2) == 0)
         {
@@ -556,24 +1331,24 @@ void calculate_difference(double **channel)
             x++;
         }
     }
-    current = channel[x][y];
-    channel[x][y] = current - last;
+    current = channel[(x * 8) + y];
+    channel[(x * 8) + y] = current - last;
     last = current;
 }
 
-void calculate_inv_difference(double **channel)
+void calculate_inv_difference(double *channel)
 {
     int x = 0, y = 1, max = 2;
-    double current = 0.0, last = channel[0][0];
+    double current = 0.0, last = channel[(0 * 8) + 0];
 
     // First half
     for(int i = 1; i < 8; i++, max++)
     {
         for(int j = 1; j < max; j++)
         {
-            current = channel[x][y];
-            channel[x][y] = current + last;
-            last = channel[x][y];
+            current = channel[(x * 8) + y];
+            channel[(x * 8) + y] = current + last;
+            last = channel[(x * 8) + y];
             if((i % 2) == 0)
             {
                 x--;
@@ -587,9 +1362,9 @@ void calculate_inv_difference(double **channel)
 
         }
         
-        current = channel[x][y];
-        channel[x][y] = current + last;
-        last = channel[x][y];
+        current = channel[(x * 8) + y];
+        channel[(x * 8) + y] = current + last;
+        last = channel[(x * 8) + y];
         if((i % 2) == 0)
         {
             y++;
@@ -607,9 +1382,9 @@ void calculate_inv_difference(double **channel)
     {
         for(int j = 0; j < max; j++)
         {
-            current = channel[x][y];
-            channel[x][y] = current + last;
-            last = channel[x][y];
+            current = channel[(x * 8) + y];
+            channel[(x * 8) + y] = current + last;
+            last = channel[(x * 8) + y];
             if((i % 2) == 0)
             {
                 x++;
@@ -621,9 +1396,9 @@ void calculate_inv_difference(double **channel)
                 y++;
             }
         }
-        current = channel[x][y];
-        channel[x][y] = current + last;
-        last = channel[x][y];
+        current = channel[(x * 8) + y];
+        channel[(x * 8) + y] = current + last;
+        last = channel[(x * 8) + y];
         if((i % 2) == 0)
         {
             y++;
@@ -633,9 +1408,9 @@ void calculate_inv_difference(double **channel)
             x++;
         }
     }
-    current = channel[x][y];
-    channel[x][y] = current + last;
-    last = channel[x][y];
+    current = channel[(x * 8) + y];
+    channel[(x * 8) + y] = current + last;
+    last = channel[(x * 8) + y];
 }
 
 unsigned int huffman_code(int value)
@@ -780,287 +1555,84 @@ unsigned int huffman_code(int value)
     return code;
 }
 
-unsigned int inverse_huffman_code(unsigned int code)
+int decode_symbol(unsigned long bits, unsigned char *length)
 {
-    unsigned int value = 0, tmp_value = 0;
-    unsigned char signal = 0;
-    if(code == 2) // The value is 0
-    {
-        value = 0;
-    }
-    // else if((code == 6 || code == 7)) // The value is -1 or 1
-    // {
-        // tmp_value = code & 0x01;
-        // if(tmp_value == 0) // Negative number
-        // {
-        //     value = -1;
-        // }
-        // else 
-        // {
-        //     value = 1;
-        // }
-    // }
-    else if(code >= 16 && code <= 19) // The value is -3,-2 or 2,3
-    {
-        tmp_value = code & 0x03;
-        signal = tmp_value & 0x02;
-        if(signal == 0) // Negative number
-        {
-            value = (-1) * ((~tmp_value) & 0x03);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
-    }
-    // else if((code >= 0 && code <= 7)) // The value is -7..-4 or 4..7
-    // {
-    //     tmp_value = code & 0x07;
-    //     signal = tmp_value & 0x04;
-    //     if(signal == 0)
-    //     {
-    //         value = (-1) * ((~tmp_value) & 0x07);
-    //     }
-    //     else 
-    //     {
-    //         value = tmp_value;
-    //     }
-    // }
-    else if(code >= 80 && code <= 95) // The value is -15..-8 or 8..15
-    {
-        tmp_value = code & 0x0F;
-        signal = tmp_value & 0x08;
-        if(signal == 0) // Negative number
-        {
-            value = (-1) * ((~tmp_value) & 0x0F);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
-    }
-    else if(code >= 192 && code <= 223) // The value is -31..-16 or 16..31
-    {
-        tmp_value = code & 0x1F;
-        signal = tmp_value & 0x10;
-        if(signal == 0)
-        {
-            value = (-1) * ((~tmp_value) & 0x1F);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
-    }
-    else if(code >= 896 && code <= 959) // The value -63..-32 or 32..63
-    {
-        tmp_value = code & 0x3F;
-        signal = tmp_value & 0x20;
-        if(signal == 0)
-        {
-            value = (-1) * ((~tmp_value) & 0x3F);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
-    }
-    else if(code >= 3840 && code <= 3967) // The value -127..-64 or 64..127
-    {
-        tmp_value = code & 0x7F;
-        signal = tmp_value & 0x40;
-        if(signal == 0)
-        {
-            value = (-1) * ((~tmp_value) & 0x7F);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
-    }
-    else if(code >= 15872 && code <= 16127) // The value -255..-128 or 128..255
+    HUFFMAN_SYMBOL symbol = DECODE_TABLE[bits >> (64 - LOOKAHEAD_BITS)];
+    unsigned long mantissa = 0;
+    int value = symbol.value, ones = 0, cat = 0;
+    if(symbol.length != 0)
     {
-        tmp_value = code & 0xFF;
-        signal = tmp_value & 0x80;
-        if(signal == 0)
-        {
-            value = (-1) * ((~tmp_value) & 0xFF);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
+        *length = symbol.length;
     }
-    else if(code >= 64512 && code <= 65023) // The value -511..-256 or 256..511
+    else // Categories 8, 9 and 10, their prefix is 5, 6 or 7 bits 1 followed by a 0
     {
-        tmp_value = code & 0x1FF;
-        signal = tmp_value & 0x100;
-        if(signal == 0)
-        {
-            value = (-1) * ((~tmp_value) * 0x1FF);
-        }
-        else 
+        while(ones < 8 && (bits & (0x8000000000000000 >> ones)) != 0)
         {
-            value = tmp_value;
+            ones++;
         }
-    }
-    else if(code >= 260096 && code <= 261119) // The value -1023..-512 or 512..1023
-    {
-        tmp_value = code & 0x3FF;
-        signal = tmp_value & 0x200;
-        if(signal == 0)
+        cat = ones + 3;
+        mantissa = (bits << (ones + 1)) >> (64 - cat);
+        if((mantissa & (1UL << (cat - 1))) == 0) // Negative number, stored as the complement of its magnitude
         {
-            value = (-1) * ((~tmp_value) * 0x3FF);
+            value = (int) mantissa - (int) ((1UL << cat) - 1);
         }
-        else 
+        else
         {
-            value = tmp_value;
+            value = (int) mantissa;
         }
+        *length = ones + 1 + cat;
     }
     return value;
 }
 
 unsigned long extract_value(unsigned long *buffer)
 {
-    unsigned int tmp_value = 0;
-    unsigned char signal = 0;
-    unsigned long prefix = 0, value = 0;
-    prefix = (*buffer) & 0xC000000000000000;
-    if(prefix == 0) // Category 3
+    unsigned char length = 0;
+    int value = decode_symbol(*buffer, &length);
+    (*buffer) <<= length;
+    return value;
+}
+
+void fill_decode_table(unsigned int code, unsigned char length, int value)
+{
+    unsigned int first = code << (LOOKAHEAD_BITS - length);
+    for(unsigned int k = 0; k < (1U << (LOOKAHEAD_BITS - length)); k++)
     {
-        value = (*buffer) & 0xF800000000000000;
-        value = (value >> 59);
-        tmp_value = value & 0x07;
-        signal = tmp_value & 0x04;
-        if(signal == 0)
-        {
-            value = (-1) * ((~tmp_value) & 0x07);
-        }
-        else 
-        {
-            value = tmp_value;
-        }
-        // printf("HEX_VALUE: %d\n", value);
-        (*buffer) <<= 5;
+        DECODE_TABLE[first + k].value = (short) value;
+        DECODE_TABLE[first + k].length = length;
     }
-    else 
+}
+
+void init_huffman_table()
+{
+    static int ready = 0;
+    unsigned int code = 0;
+    int value = 0, cat = 0;
+    if(ready == 0)
     {
-        prefix = (*buffer) & 0xE000000000000000; // Mask for 3 bits
-        if(prefix == 0x4000000000000000) // Category 0 (for DC)
-        {
-            value = (*buffer) & 0xE000000000000000;
-            value = (value >> 61);
-            value = inverse_huffman_code(value);
-            // printf("HEX_VALUE: %d\n", value);
-            (*buffer) <<= 3;
-        }
-        else if(prefix == 0x6000000000000000) // Category 1
-        {
-            value = (*buffer) & 0xF000000000000000;
-            value = (value >> 60);
-            tmp_value = value & 0x01;
-            if(tmp_value == 0) // Negative number
-            {
-                value = -1;
-            }
-            else 
-            {
-                value = 1;
-            }
-            // printf("HEX_VALUE: %d\n", value);
-            (*buffer) <<= 4;
-        }
-        else if(prefix == 0x8000000000000000) // Category 2
-        {
-            value = (*buffer) & 0xF800000000000000;
-            value = (value >> 59);
-            value = inverse_huffman_code(value);
-            // printf("HEX_VALUE: %d\n", value);
-            (*buffer) <<= 5;
-        }
-        else if(prefix == 0xA000000000000000) // Category 4
-        {
-            value = (*buffer) & 0xFE00000000000000;
-            value = (value >> 57);
-            value = inverse_huffman_code(value);
-            // printf("HEX_VALUE: %d\n", value);
-            (*buffer) <<= 7;
-        }
-        else if(prefix == 0xC000000000000000) // Category 5
+        for(int i = 0; i < HUFFMAN_ENTRIES; i++)
         {
-            value = (*buffer) & 0xFF00000000000000;
-            value = (value >> 56);
-            value = inverse_huffman_code(value);
-            // printf("HEX_VALUE: %d\n", value);
-            (*buffer) <<= 8;
+            value = i - HUFFMAN_RANGE;
+            code = huffman_code(value);
+            // category() only knows the codes whose category can't be told by the value alone
+            if(value == 1 || value == -1) cat = 1;
+            else if((value >= -7 && value <= -4) || (value >= 4 && value <= 7)) cat = 3;
+            else cat = category(code);
+            HUFFMAN_TABLE[i].code = code;
+            HUFFMAN_TABLE[i].length = (cat >= 0) ? CATEGORY_LENGTH[cat] : 0;
         }
-        else 
+
+        // Every pattern starting with a short code decodes to it, the others are left to the slow path
+        for(int i = 0; i < HUFFMAN_ENTRIES; i++)
         {
-            prefix = (*buffer) & 0xF000000000000000;
-            if(prefix == 0xE000000000000000) // Category 6
-            {
-                value = (*buffer) & 0xFFC0000000000000;
-                value = (value >> 54);
-                value = inverse_huffman_code(value);
-                // printf("HEX_VALUE: %d\n", value);
-                (*buffer) <<= 10;
-            }
-            else
+            if(HUFFMAN_TABLE[i].length != 0 && HUFFMAN_TABLE[i].length <= LOOKAHEAD_BITS)
             {
-                prefix = (*buffer) & 0xF800000000000000;
-                if(prefix == 0xF000000000000000) // Category 7
-                {
-                    value = (*buffer) & 0xFFF0000000000000;
-                    value = (value >> 52);
-                    value = inverse_huffman_code(value);
-                    // printf("HEX_VALUE: %d\n", value);
-                    (*buffer) <<= 12;
-                }
-                else 
-                {
-                    prefix = (*buffer) & 0xFC00000000000000;
-                    if(prefix == 0xF800000000000000) // Category 8
-                    {
-                        value = (*buffer) & 0xFFFC000000000000;
-                        value = (value >> 50);
-                        value = inverse_huffman_code(value);
-                        // printf("HEX_VALUE: %d\n", value);
-                        (*buffer) <<= 14;
-                    }
-                    else 
-                    {
-                        prefix = (*buffer) & 0xFE00000000000000;
-                        if(prefix == 0xFC00000000000000) // Category 9
-                        {
-                            value = (*buffer) & 0xFFFF000000000000;
-                            value = (value >> 48);
-                            value = inverse_huffman_code(value);
-                            // printf("HEX_VALUE: %d\n", value);
-                            (*buffer) <<= 16;
-                        }
-                        else 
-                        {
-                            prefix = (*buffer) & 0xFF00000000000000;
-                            if(prefix == 0xFE00000000000000) // Category A or 10
-                            {
-                                value = (*buffer) & 0xFFFFC00000000000;
-                                value = (value >> 46);
-                                value = inverse_huffman_code(value);
-                                // printf("HEX_VALUE: %d\n", value);
-                                (*buffer) <<= 18;
-                            }
-                            else if(prefix == 0xFF00000000000000) // EOB
-                            {
-                                value = EOB;
-                                (*buffer) <<= 8;
-                            }
-                        }
-                    }
-                }
+                fill_decode_table(HUFFMAN_TABLE[i].code, HUFFMAN_TABLE[i].length, i - HUFFMAN_RANGE);
             }
         }
+        fill_decode_table(EOB_CODE, EOB_LENGTH, EOB);
+        ready = 1;
     }
-    return value;
 }
 
 int category(unsigned int code)
@@ -1105,127 +1677,696 @@ int category(unsigned int code)
     return value;
 }
 
-void bmp_compress(BMP_FILE *bmp, const char *file_name)
+void bmp_set_format(BMP_FILE *bmp, unsigned short format)
 {
-    FILE *arq = NULL;
     if(bmp != NULL)
     {
-        if(file_name != NULL)
-        {
-            arq = fopen(file_name, "wb");
-            if(arq != NULL)
-            {
-                fwrite(&bmp->header.bmpSignature, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.bmpFileSize, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.bmpReserverd1, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.bmpReserverd2, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.bmpPixelDataOffset, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpHeaderSize, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpWidth, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpHeight, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpPlanes, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.info_header.bmpBitsPerPixel, sizeof(unsigned short), 1, arq);
-                fwrite(&bmp->header.info_header.bmpCompression, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpImageSize, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpXPixelsPerMeter, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpYPixelsPerMeter, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpTotalColors, sizeof(unsigned int), 1, arq);
-                fwrite(&bmp->header.info_header.bmpImportantColors, sizeof(unsigned int), 1, arq);
-                
-                fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
-                for(int i = 0; i < bmp->channels.qt_blocks; i++)
-                {
-                    write_in(bmp->channels.y[i], arq);
-                    write_in(bmp->channels.cb[i], arq);
-                    write_in(bmp->channels.cr[i], arq);
-                }
-                // write_in(bmp->channels.y[0], arq);
-            }
-            fclose(arq);
-        }
+        bmp->format = (format == FORMAT_STREAM || format == FORMAT_RUN_SIZE || format == FORMAT_OPTIMIZED || format == FORMAT_RANS) ? format : FORMAT_WORDS;
+    }
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
     }
+    error_catch(ERROR);
 }
 
-BMP_FILE *bmp_decompress(const char *file_name)
+int bmp_compress(BMP_FILE *bmp, const char *file_name)
 {
     FILE *arq = NULL;
-    BMP_FILE *bmp = NULL;
-    if(file_name != NULL)
+    BIT_WRITER out;
+    CONTAINER container;
+    unsigned int count = 0, entries = 0, *offsets = NULL, *index = NULL;
+    long start = 0;
+    int err = -1;
+    if(bmp != NULL)
     {
-        arq = fopen(file_name, "rb");
-        if(arq != NULL)
+        if(file_name != NULL)
         {
-            bmp = (BMP_FILE *) malloc(sizeof(BMP_FILE));
-            if(bmp != NULL)
+            arq = fopen(file_name, "wb");
+            count = segment_count(bmp);
+            if(bmp->segment_blocks > 0)
             {
-                fread(&bmp->header.bmpSignature, sizeof(unsigned short), 1, arq);
-                if(bmp->header.bmpSignature == BMP_SIG) // Verify if it's a BMP file
+                offsets = (unsigned int *) calloc(count, sizeof(unsigned int));
+            }
+            if(bmp->index_blocks > 0 && bmp->channels.qt_blocks > 0 && bmp->format != FORMAT_RANS) // rANS can only start at the start of a segment
+            {
+                entries = index_count(bmp->channels.qt_blocks, bmp->index_blocks);
+                index = (unsigned int *) calloc(entries, sizeof(unsigned int));
+            }
+            if(arq != NULL && (bmp->segment_blocks == 0 || offsets != NULL) && (entries == 0 || index != NULL))
+            {
+                init_huffman_table();
+                init_symbol_tables();
+                // The optimized format can fall back to the standard tables, the container must have the format really written
+                if(bmp->format == FORMAT_OPTIMIZED && optimize_tables(bmp) != 0) error_catch(WARN_STANDARD_TABLES);
+                fill_container(bmp, &container, offsets, count, index, entries);
+                container_write(arq, &container); // Room for the indexes and the size of the data, filled at the end
+                start = ftell(arq);
+                if(bit_writer_open(&out, arq, BIT_WRITER_CAPACITY) == 0)
                 {
-                    fread(&bmp->header.bmpFileSize, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.bmpReserverd1, sizeof(unsigned short), 1, arq);
-                    fread(&bmp->header.bmpReserverd2, sizeof(unsigned short), 1, arq);
-                    fread(&bmp->header.bmpPixelDataOffset, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpHeaderSize, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpWidth, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpHeight, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpPlanes, sizeof(unsigned short), 1, arq);
-                    fread(&bmp->header.info_header.bmpBitsPerPixel, sizeof(unsigned short), 1, arq);
-                    fread(&bmp->header.info_header.bmpCompression, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpImageSize, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpXPixelsPerMeter, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpYPixelsPerMeter, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpTotalColors, sizeof(unsigned int), 1, arq);
-                    fread(&bmp->header.info_header.bmpImportantColors, sizeof(unsigned int), 1, arq);
-                    
-                    bmp->channels.qt_blocks = (bmp->header.info_header.bmpHeight * bmp->header.info_header.bmpWidth) / 64;
-
-                    // Alloc pixels
-                    bmp->channels.y = (double ***) malloc(sizeof(double **) * bmp->channels.qt_blocks);
-                    bmp->channels.cb = (double ***) malloc(sizeof(double **) * bmp->channels.qt_blocks);
-                    bmp->channels.cr = (double ***) malloc(sizeof(double **) * bmp->channels.qt_blocks);
-                    for(int i = 0; i < bmp->channels.qt_blocks; i++)
-                    {
-                        bmp->channels.y[i] = (double **) malloc(sizeof(double *) * 8);
-                        bmp->channels.cb[i] = (double **) malloc(sizeof(double *) * 8);
-                        bmp->channels.cr[i] = (double **) malloc(sizeof(double *) * 8);
-                        for(int j = 0; j < 8; j++)
-                        {
-                            bmp->channels.y[i][j] = (double *) malloc(sizeof(double) * 8);
-                            bmp->channels.cb[i][j] = (double *) malloc(sizeof(double) * 8);
-                            bmp->channels.cr[i][j] = (double *) malloc(sizeof(double) * 8);
-                        }
-                    }
-
-                    fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
-                    for(int k = 0; k < bmp->channels.qt_blocks; k++)
+                    if(bmp->format == FORMAT_OPTIMIZED)
                     {
-                        read_of(arq, bmp->channels.y[k]);
-                        read_of(arq, bmp->channels.cb[k]);
-                        read_of(arq, bmp->channels.cr[k]);
+                        write_tables(bmp->tables, &out);
                     }
+                    encode_segments(bmp, offsets, index, &out);
+                    bit_writer_close(&out);
+                    container.data_bytes = (unsigned long long) (ftell(arq) - start);
+                    rewind(arq);
+                    container_write(arq, &container);
+                    if(ferror(arq) != 0) ERROR = ERR_CREATE_BITMAP;
+                    err = (ERROR == 0) ? 0 : -1; // The errors of the coding threads were handed to this one
                 }
             }
+            else if(arq != NULL)
+            {
+                ERROR = ERR_ALLOCATE_MEMORY;
+            }
+            else
+            {
+                ERROR = ERR_COULD_NOT_OPEN_FILE;
+            }
+            free(offsets);
+            free(index);
+            if(arq != NULL && fclose(arq) != 0)
+            {
+                ERROR = ERR_CREATE_BITMAP;
+                err = -1;
+            }
+        }
+        else
+        {
+            ERROR = ERR_EMPTY_FILE_NAME;
         }
-        fclose(arq);
     }
-    return bmp;
+    else
+    {
+        ERROR = ERR_BMP_NOT_EXIST;
+    }
+    error_catch(ERROR);
+    return err;
 }
 
-void write_in(double **block, FILE *arq)
+int bmp_compress_stream(const char *in_file_name, const char *out_file_name, unsigned short format, unsigned short predictor, unsigned int segment_blocks, unsigned int threads)
 {
-    BUFFER b;
-    b.buffer = 0;
-    b.remaining_bits = 64;
-    unsigned long aux = 0;
+    STREAM_PIPELINE pipeline;
+    STREAM_WORKER *workers = NULL;
+    STREAM_BAND *bands = NULL, *band_ptr = NULL;
+    STREAM_CHUNK chunks[STREAM_CHUNKS];
+    BMP_FILE file, *file_ptr = &file;
+    pthread_t reader, writer;
+    unsigned char header[BMP_HEADER_SIZE];
+    CONTAINER container;
+    unsigned int count = 0, quantity = 0, started = 0, ready = 0, *offsets = NULL;
+    long start = 0;
+    int err = 0;
+    if(threads == 0) threads = thread_pool_cores();
+    if(in_file_name != NULL && out_file_name != NULL)
+    {
+        memset(&pipeline, 0, sizeof(STREAM_PIPELINE));
+        pipeline.in = fopen(in_file_name, "rb");
+        pipeline.out = fopen(out_file_name, "wb");
+        if(pipeline.in != NULL && pipeline.out != NULL)
+        {
+            memset(header, 0, BMP_HEADER_SIZE);
+            fread(header, 1, BMP_HEADER_SIZE, pipeline.in);
+            parse_header(header, &file.header);
+            if(file.header.bmpSignature == BMP_SIG) // Verify if it's a BMP file
+            {
+                pipeline.qt_blocks = (file.header.info_header.bmpHeight * file.header.info_header.bmpWidth) / 64;
+
+                // A band holds 8 rows of the image, so the memory used depends only on the width and the threads
+                file.dct_engine = DCT_REFERENCE;
+                bmp_set_format(&file, (format == FORMAT_OPTIMIZED || format == FORMAT_RANS) ? FORMAT_RUN_SIZE : format); // One pass only, the optimized tables and rANS need the whole image
+                if(format == FORMAT_OPTIMIZED || format == FORMAT_RANS) error_catch(WARN_STREAM_RUN_SIZE);
+                bmp_set_predictor(&file, predictor);
+                file.tables = NULL;
+                file.segment_blocks = segment_blocks;
+                file.index_blocks = 0;
+                file.pool = NULL;
+                file.shared_pool = 0;
+                file.channels.qt_blocks = pipeline.qt_blocks; // Whole image, only to count the segments
+                count = segment_count(&file);
+                if(segment_blocks > 0)
+                {
+                    offsets = (unsigned int *) calloc(count, sizeof(unsigned int));
+                }
+                pipeline.band_blocks = file.header.info_header.bmpWidth / 8;
+                if(pipeline.band_blocks == 0) pipeline.band_blocks = 1;
+                pipeline.workers = threads;
+
+                // Every band and chunk exists from the start, the rings can hold all of them so a push never waits for long
+                quantity = pipeline.workers * STREAM_BANDS_BY_WORKER;
+                bands = (STREAM_BAND *) calloc(quantity, sizeof(STREAM_BAND));
+                workers = (STREAM_WORKER *) calloc(pipeline.workers, sizeof(STREAM_WORKER));
+                pipeline.read = (RING_BUFFER **) calloc(pipeline.workers, sizeof(RING_BUFFER *));
+                pipeline.transformed = (RING_BUFFER **) calloc(pipeline.workers, sizeof(RING_BUFFER *));
+                pipeline.free_bands = ring_buffer_create(quantity);
+                pipeline.free_chunks = ring_buffer_create(STREAM_CHUNKS);
+                pipeline.written = ring_buffer_create(STREAM_CHUNKS + 1);
+                ready = (bands != NULL && workers != NULL && pipeline.read != NULL && pipeline.transformed != NULL && pipeline.free_bands != NULL &&
+                         pipeline.free_chunks != NULL && pipeline.written != NULL && (segment_blocks == 0 || offsets != NULL)) ? 1 : 0;
+                for(unsigned int i = 0; ready == 1 && i < pipeline.workers; i++)
+                {
+                    pipeline.read[i] = ring_buffer_create(quantity + 1);
+                    pipeline.transformed[i] = ring_buffer_create(quantity);
+                    if(pipeline.read[i] == NULL || pipeline.transformed[i] == NULL) ready = 0;
+                }
+                for(unsigned int i = 0; ready == 1 && i < quantity; i++)
+                {
+                    bands[i].coefficients = file;
+                    bands[i].coefficients.channels.qt_blocks = pipeline.band_blocks;
+                    bmp_alloc_channels(&bands[i].coefficients);
+                    bands[i].pixels = (unsigned char *) malloc(pipeline.band_blocks * BLOCK_BYTES);
+                    if(bands[i].coefficients.channels.y == NULL || bands[i].pixels == NULL) ready = 0;
+                    else ring_buffer_push(pipeline.free_bands, &bands[i]);
+                }
+                for(unsigned int i = 0; i < STREAM_CHUNKS; i++)
+                {
+                    chunks[i].data = (ready == 1) ? (unsigned char *) malloc(STREAM_CHUNK_BYTES) : NULL;
+                    chunks[i].capacity = STREAM_CHUNK_BYTES;
+                    chunks[i].size = 0;
+                    if(chunks[i].data == NULL) ready = 0;
+                    else ring_buffer_push(pipeline.free_chunks, &chunks[i]);
+                }
+
+                if(ready == 1)
+                {
+                    fill_container(&file, &container, offsets, count, NULL, 0);
+                    container_write(pipeline.out, &container); // Room for the index and the size of the data, filled at the end
+                    start = ftell(pipeline.out);
+                    bmp_init_tables(); // Before the threads, which only read them
+                    fseek(pipeline.in, file.header.bmpPixelDataOffset, SEEK_SET);
+
+                    // The workers wait for their first band, a worker that could not start just leaves the pipeline smaller
+                    for(started = 0; started < pipeline.workers; started++)
+                    {
+                        workers[started].pipeline = &pipeline;
+                        workers[started].index = started;
+                        if(pthread_create(&workers[started].thread, NULL, stream_worker, &workers[started]) != 0) break;
+                    }
+                    pipeline.workers = started;
+                    if(started > 0 && pthread_create(&writer, NULL, stream_writer, &pipeline) == 0)
+                    {
+                        if(pthread_create(&reader, NULL, stream_reader, &pipeline) == 0)
+                        {
+                            stream_encode(&pipeline, &file, offsets);
+                            pthread_join(reader, NULL);
+                        }
+                        else
+                        {
+                            for(unsigned int i = 0; i < pipeline.workers; i++)
+                            {
+                                ring_buffer_push(pipeline.read[i], NULL);
+                            }
+                            ring_buffer_push(pipeline.written, NULL);
+                            ERROR = ERR_ALLOCATE_MEMORY;
+                            err = -1;
+                        }
+                        pthread_join(writer, NULL);
+                    }
+                    else
+                    {
+                        for(unsigned int i = 0; i < pipeline.workers; i++)
+                        {
+                            ring_buffer_push(pipeline.read[i], NULL);
+                        }
+                        ERROR = ERR_ALLOCATE_MEMORY;
+                        err = -1;
+                    }
+                    for(unsigned int i = 0; i < started; i++)
+                    {
+                        pthread_join(workers[i].thread, NULL);
+                    }
+                    if(pipeline.error != 0)
+                    {
+                        ERROR = pipeline.error;
+                        err = -1;
+                    }
+                    if(err == 0)
+                    {
+                        container.data_bytes = (unsigned long long) (ftell(pipeline.out) - start);
+                        rewind(pipeline.out);
+                        container_write(pipeline.out, &container);
+                    }
+                }
+                else
+                {
+                    ERROR = ERR_ALLOCATE_MEMORY;
+                    err = -1;
+                }
+                for(unsigned int i = 0; i < STREAM_CHUNKS; i++)
+                {
+                    free(chunks[i].data);
+                }
+                for(unsigned int i = 0; bands != NULL && i < quantity; i++)
+                {
+                    band_ptr = &bands[i];
+                    file_ptr = &band_ptr->coefficients;
+                    bmp_free_channels(&file_ptr);
+                    free(band_ptr->pixels);
+                }
+                for(unsigned int i = 0; i < threads; i++)
+                {
+                    if(pipeline.read != NULL) ring_buffer_destroy(&pipeline.read[i]);
+                    if(pipeline.transformed != NULL) ring_buffer_destroy(&pipeline.transformed[i]);
+                }
+                ring_buffer_destroy(&pipeline.free_bands);
+                ring_buffer_destroy(&pipeline.free_chunks);
+                ring_buffer_destroy(&pipeline.written);
+                free(pipeline.read);
+                free(pipeline.transformed);
+                free(workers);
+                free(bands);
+                free(offsets);
+            }
+            else
+            {
+                ERROR = ERR_NOT_BITMAP;
+                err = -1;
+            }
+        }
+        else
+        {
+            ERROR = ERR_COULD_NOT_OPEN_FILE;
+            err = -1;
+        }
+        if(pipeline.in != NULL) fclose(pipeline.in);
+        if(pipeline.out != NULL) fclose(pipeline.out);
+    }
+    else
+    {
+        ERROR = ERR_EMPTY_FILE_NAME;
+        err = -1;
+    }
+    error_catch(ERROR);
+    return err;
+}
+
+void *stream_reader(void *arg)
+{
+    STREAM_PIPELINE *pipeline = (STREAM_PIPELINE *) arg;
+    STREAM_BAND *band = NULL;
+    size_t read_bytes = 0;
+    unsigned int n = 0, blocks = 0;
+    for(unsigned int k = 0; k < pipeline->qt_blocks; k += blocks, n++)
+    {
+        blocks = pipeline->qt_blocks - k;
+        if(blocks > pipeline->band_blocks) blocks = pipeline->band_blocks;
+        band = (STREAM_BAND *) ring_buffer_pop(pipeline->free_bands);
+        band->first = k;
+        band->blocks = blocks;
+        read_bytes = fread(band->pixels, 1, blocks * BLOCK_BYTES, pipeline->in);
+        if(read_bytes < blocks * BLOCK_BYTES) // Short file, the missing pixels are black
+        {
+            memset(band->pixels + read_bytes, 0, (blocks * BLOCK_BYTES) - read_bytes);
+        }
+        ring_buffer_push(pipeline->read[n % pipeline->workers], band); // The band belongs to the next stages from here
+    }
+    for(unsigned int i = 0; i < pipeline->workers; i++)
+    {
+        ring_buffer_push(pipeline->read[i], NULL);
+    }
+    return NULL;
+}
+
+void *stream_worker(void *arg)
+{
+    STREAM_WORKER *worker = (STREAM_WORKER *) arg;
+    STREAM_BAND *band = NULL;
+    double *y = NULL, *cb = NULL, *cr = NULL;
+    while((band = (STREAM_BAND *) ring_buffer_pop(worker->pipeline->read[worker->index])) != NULL)
+    {
+        convert_band(band->pixels, &band->coefficients, 0, band->blocks);
+        for(unsigned int i = 0; i < band->blocks; i++)
+        {
+            y = band->coefficients.channels.y + (i * BLOCK_SIZE);
+            cb = band->coefficients.channels.cb + (i * BLOCK_SIZE);
+            cr = band->coefficients.channels.cr + (i * BLOCK_SIZE);
+            foward_dct(y);
+            foward_dct(cb);
+            foward_dct(cr);
+            quantization_luminance(y);
+            quantization_chrominance(cb);
+            quantization_chrominance(cr);
+            if(band->coefficients.predictor == PREDICT_ZIGZAG) // The DC predictor chains the bands, the encoder applies it
+            {
+                calculate_difference(y);
+                calculate_difference(cb);
+                calculate_difference(cr);
+            }
+        }
+        ring_buffer_push(worker->pipeline->transformed[worker->index], band);
+    }
+    return NULL;
+}
+
+void *stream_writer(void *arg)
+{
+    STREAM_PIPELINE *pipeline = (STREAM_PIPELINE *) arg;
+    STREAM_CHUNK *chunk = NULL;
+    while((chunk = (STREAM_CHUNK *) ring_buffer_pop(pipeline->written)) != NULL)
+    {
+        if(fwrite(chunk->data, 1, chunk->size, pipeline->out) != chunk->size)
+        {
+            pipeline->error = ERR_CREATE_BITMAP;
+        }
+        ring_buffer_push(pipeline->free_chunks, chunk);
+    }
+    return NULL;
+}
+
+void stream_encode(STREAM_PIPELINE *pipeline, BMP_FILE *file, unsigned int *offsets)
+{
+    double last[3] = { 0.0, 0.0, 0.0 }; // DC of the previous block of each channel, carried from band to band
+    BIT_WRITER writer;
+    STREAM_BAND *band = NULL;
+    unsigned int segment_blocks = file->segment_blocks, run = 0, n = 0, k = 0, blocks = 0;
+    if(bit_writer_open(&writer, NULL, STREAM_CHUNK_BYTES) == 0)
+    {
+        for(k = 0; k < pipeline->qt_blocks; k += blocks, n++)
+        {
+            band = (STREAM_BAND *) ring_buffer_pop(pipeline->transformed[n % pipeline->workers]);
+            blocks = band->blocks; // The band goes back to the reader before the next one
+            if(band->coefficients.predictor == PREDICT_DC)
+            {
+                for(unsigned int i = 0; i < band->blocks; i++)
+                {
+                    if(segment_blocks > 0 && ((k + i) % segment_blocks) == 0) // A segment starts from zero, like the first block
+                    {
+                        last[0] = last[1] = last[2] = 0.0;
+                    }
+                    predict_dc(band->coefficients.channels.y + (i * BLOCK_SIZE), &last[0]);
+                    predict_dc(band->coefficients.channels.cb + (i * BLOCK_SIZE), &last[1]);
+                    predict_dc(band->coefficients.channels.cr + (i * BLOCK_SIZE), &last[2]);
+                }
+            }
+            for(unsigned int i = 0; i < band->blocks; i += run) // Split at the segment boundaries inside the band
+            {
+                run = band->blocks - i;
+                if(segment_blocks > 0)
+                {
+                    if(((k + i) % segment_blocks) == 0)
+                    {
+                        bit_writer_align(&writer);
+                        offsets[(k + i) / segment_blocks] = (unsigned int) (bit_writer_tell(&writer) / 8);
+                    }
+                    if(run > segment_blocks - ((k + i) % segment_blocks)) run = segment_blocks - ((k + i) % segment_blocks);
+                }
+                encode_blocks(&band->coefficients, i, run, &writer);
+            }
+            ring_buffer_push(pipeline->free_bands, band);
+            if(writer.size >= (STREAM_CHUNK_BYTES / 2)) stream_chunk(pipeline, &writer);
+        }
+        bit_writer_align(&writer);
+        stream_chunk(pipeline, &writer);
+        bit_writer_close(&writer);
+    }
+    else
+    {
+        // Nothing is coded, the bands still have to be taken so the reader can finish
+        for(k = 0; k < pipeline->qt_blocks; k += blocks, n++)
+        {
+            band = (STREAM_BAND *) ring_buffer_pop(pipeline->transformed[n % pipeline->workers]);
+            blocks = band->blocks;
+            ring_buffer_push(pipeline->free_bands, band);
+        }
+    }
+    ring_buffer_push(pipeline->written, NULL);
+}
+
+void stream_chunk(STREAM_PIPELINE *pipeline, BIT_WRITER *writer)
+{
+    STREAM_CHUNK *chunk = (STREAM_CHUNK *) ring_buffer_pop(pipeline->free_chunks);
+    size_t capacity = writer->capacity;
+    chunk->data = bit_writer_swap(writer, chunk->data, chunk->capacity, &chunk->size);
+    chunk->capacity = capacity;
+    ring_buffer_push(pipeline->written, chunk);
+}
+
+BMP_FILE *bmp_decompress(const char *file_name)
+{
+    return bmp_decompress_parallel(file_name, 1);
+}
+
+BMP_FILE *bmp_decompress_parallel(const char *file_name, unsigned int threads)
+{
+    FILE *arq = NULL;
+    BIT_READER in;
+    BMP_FILE *bmp = NULL;
+    DECODE_JOB job;
+    DECODE_UNIT *units = NULL;
+    unsigned char magic[4];
+    unsigned int quantity = 0, run = 0, *offsets = NULL, *index = NULL;
+    size_t start = 0;
+    int err = 0;
+    if(file_name != NULL)
+    {
+        arq = fopen(file_name, "rb");
+        if(arq != NULL)
+        {
+            bmp = bmp_create();
+            if(bmp != NULL)
+            {
+                bmp_set_threads(bmp, threads);
+                memset(magic, 0, sizeof(magic));
+                fread(magic, 1, sizeof(magic), arq);
+                rewind(arq);
+                // The files written before the container start with the BMP header of the image
+                if(memcmp(magic, CONTAINER_MAGIC, sizeof(magic)) == 0) err = read_container(arq, bmp, &offsets, &index);
+                else err = read_legacy(arq, bmp, &offsets, &index);
+                if(err == 0) err = bmp_alloc_channels(bmp); // The geometry was checked against the size of the file first
+                if(err == 0)
+                {
+                    init_huffman_table();
+                    init_symbol_tables();
+                    quantity = segment_count(bmp) + ((index != NULL) ? index_count(bmp->channels.qt_blocks, bmp->index_blocks) : 0);
+                    units = (DECODE_UNIT *) malloc(quantity * sizeof(DECODE_UNIT));
+                    if(bmp->format == FORMAT_OPTIMIZED)
+                    {
+                        bmp->tables = (SYMBOL_TABLE *) malloc(4 * sizeof(SYMBOL_TABLE));
+                    }
+                    if((bmp->format == FORMAT_OPTIMIZED && bmp->tables == NULL) || units == NULL)
+                    {
+                        ERROR = ERR_ALLOCATE_MEMORY;
+                        err = -1;
+                    }
+                    else if(bit_reader_open(&in, arq) == 0)
+                    {
+                        if(bmp->tables != NULL) err = read_tables(&in, bmp->tables);
+                        if(err == 0) // A corrupted table would decode past its arrays
+                        {
+                            start = (bit_reader_tell(&in) + 7) & ~((size_t) 7); // The first segment starts on the byte after the tables
+                            // Runs break at every segment and every entry of the block index
+                            quantity = 0;
+                            for(unsigned int i = 0; i < bmp->channels.qt_blocks; i += run)
+                            {
+                                run = bmp->channels.qt_blocks - i;
+                                if(bmp->segment_blocks > 0 && run > (bmp->segment_blocks - (i % bmp->segment_blocks))) run = bmp->segment_blocks - (i % bmp->segment_blocks);
+                                if(index != NULL && run > (bmp->index_blocks - (i % bmp->index_blocks))) run = bmp->index_blocks - (i % bmp->index_blocks);
+                                // A segment is found by its offset, so a damaged one does not shift the next ones
+                                units[quantity].bit = (offsets != NULL) ? ((size_t) offsets[i / bmp->segment_blocks] * 8) : start;
+                                if(index != NULL && (bmp->segment_blocks == 0 || (i % bmp->segment_blocks) != 0)) units[quantity].bit += index[i / bmp->index_blocks];
+                                units[quantity].first = i;
+                                units[quantity].count = run;
+                                quantity++;
+                            }
+                            job.bmp = bmp;
+                            job.in = &in;
+                            job.units = units;
+                            thread_pool_run(bmp->pool, decode_unit_task, &job, quantity, 1);
+                        }
+                        bit_reader_close(&in);
+                    }
+                    else
+                    {
+                        err = -1;
+                    }
+                }
+                free(units);
+                free(offsets);
+                free(index);
+                if(err != 0) bmp_destroy(&bmp); // Nothing was decoded, an empty image would pass for the result
+                error_catch(ERROR);
+            }
+            fclose(arq);
+        }
+        else
+        {
+            ERROR = ERR_COULD_NOT_OPEN_FILE;
+            error_catch(ERROR);
+        }
+    }
+    return bmp;
+}
+
+void fill_container(const BMP_FILE *bmp, CONTAINER *container, unsigned int *offsets, unsigned int segments, unsigned int *index, unsigned int entries)
+{
+    memset(container, 0, sizeof(CONTAINER));
+    container->version = CONTAINER_VERSION;
+    container->width = bmp->header.info_header.bmpWidth;
+    container->height = bmp->header.info_header.bmpHeight;
+    container->format = bmp->format;
+    container->predictor = bmp->predictor;
+    container->dct_engine = bmp->dct_engine;
+    container->subsampling = SUBSAMPLING_444;
+    memcpy(container->quant[0], QUANT_LUMINANCE, sizeof(container->quant[0]));
+    memcpy(container->quant[1], QUANT_CHROMI, sizeof(container->quant[1]));
+    format_header(&bmp->header, container->bmp_header);
+    container->has_bmp_header = 1;
+    // The arrays are filled while the data is coded, the container is written again at the end
+    container->segment_blocks = (offsets != NULL) ? bmp->segment_blocks : 0;
+    container->segments = (offsets != NULL) ? segments : 0;
+    container->offsets = offsets;
+    container->index_blocks = (index != NULL) ? bmp->index_blocks : 0;
+    container->entries = (index != NULL) ? entries : 0;
+    container->index = index;
+}
+
+int read_container(FILE *arq, BMP_FILE *bmp, unsigned int **offsets, unsigned int **index)
+{
+    CONTAINER container;
+    int err = container_read(arq, &container);
+    if(err == 0)
+    {
+        // The tables are only recorded for now, coefficients quantized with other ones would decode to a wrong image
+        if(container.format > FORMAT_RANS || container.predictor > PREDICT_DC || container.subsampling != SUBSAMPLING_444 ||
+           memcmp(container.quant[0], QUANT_LUMINANCE, sizeof(container.quant[0])) != 0 || memcmp(container.quant[1], QUANT_CHROMI, sizeof(container.quant[1])) != 0)
+        {
+            ERROR = ERR_UNSUPPORTED_FILE;
+            err = -1;
+        }
+        else if(check_geometry(arq, container.width, container.height, container.format, container.data_bytes, &bmp->channels.qt_blocks) != 0 ||
+                (container.offsets != NULL && (container.segment_blocks == 0 || container.segments != index_count(bmp->channels.qt_blocks, container.segment_blocks))) ||
+                (container.index != NULL && (container.index_blocks == 0 || container.entries != index_count(bmp->channels.qt_blocks, container.index_blocks))))
+        {
+            ERROR = ERR_CORRUPTED_FILE;
+            err = -1;
+        }
+        else
+        {
+            if(container.has_bmp_header != 0)
+            {
+                parse_header(container.bmp_header, &bmp->header);
+            }
+            else // Plain 24 bits image of the size in the container
+            {
+                memset(&bmp->header, 0, sizeof(BMP_HEADER));
+                bmp->header.bmpSignature = BMP_SIG;
+                bmp->header.bmpPixelDataOffset = BMP_HEADER_SIZE;
+                bmp->header.bmpFileSize = BMP_HEADER_SIZE + (container.width * container.height * 3);
+                bmp->header.info_header.bmpHeaderSize = BMP_HEADER_SIZE - 14;
+                bmp->header.info_header.bmpWidth = container.width;
+                bmp->header.info_header.bmpHeight = container.height;
+                bmp->header.info_header.bmpPlanes = 1;
+                bmp->header.info_header.bmpBitsPerPixel = 24;
+                bmp->header.info_header.bmpImageSize = container.width * container.height * 3;
+            }
+            bmp->header.info_header.bmpWidth = container.width; // The container has the last word on the geometry
+            bmp->header.info_header.bmpHeight = container.height;
+            bmp_set_format(bmp, container.format);
+            bmp_set_predictor(bmp, container.predictor);
+            bmp->segment_blocks = (container.offsets != NULL) ? container.segment_blocks : 0;
+            bmp->index_blocks = (container.index != NULL) ? container.index_blocks : 0;
+            *offsets = container.offsets; // The caller frees them from here
+            *index = container.index;
+        }
+        if(err != 0) container_free(&container);
+    }
+    return err;
+}
+
+int read_legacy(FILE *arq, BMP_FILE *bmp, unsigned int **offsets, unsigned int **index)
+{
+    unsigned char header[BMP_HEADER_SIZE];
+    unsigned short flags = 0;
+    int err = 0;
+    memset(header, 0, BMP_HEADER_SIZE);
+    fread(header, 1, BMP_HEADER_SIZE, arq);
+    parse_header(header, &bmp->header);
+    if(bmp->header.bmpSignature == BMP_SIG) // Verify if it's a BMP file
+    {
+        fseek(arq, bmp->header.bmpPixelDataOffset, SEEK_SET);
+        bmp_set_format(bmp, bmp->header.bmpReserverd1 & ~(SEGMENTS_FLAG | INDEX_FLAG));
+        bmp_set_predictor(bmp, bmp->header.bmpReserverd2);
+        flags = bmp->header.bmpReserverd1 & (SEGMENTS_FLAG | INDEX_FLAG);
+        bmp->header.bmpReserverd1 &= ~(SEGMENTS_FLAG | INDEX_FLAG);
+        if(check_geometry(arq, bmp->header.info_header.bmpWidth, bmp->header.info_header.bmpHeight, bmp->format, 0, &bmp->channels.qt_blocks) != 0)
+        {
+            ERROR = ERR_CORRUPTED_FILE;
+            flags = 0;
+            err = -1;
+        }
+        if((flags & SEGMENTS_FLAG) != 0)
+        {
+            *offsets = read_index(arq, &bmp->segment_blocks, bmp->channels.qt_blocks);
+        }
+        if((flags & INDEX_FLAG) != 0 && ((flags & SEGMENTS_FLAG) == 0 || *offsets != NULL))
+        {
+            *index = read_index(arq, &bmp->index_blocks, bmp->channels.qt_blocks);
+        }
+        if(((flags & SEGMENTS_FLAG) != 0 && *offsets == NULL) || ((flags & INDEX_FLAG) != 0 && *index == NULL))
+        {
+            free(*offsets);
+            *offsets = NULL;
+            err = -1;
+        }
+    }
+    else
+    {
+        ERROR = ERR_NOT_BITMAP;
+        err = -1;
+    }
+    return err;
+}
+
+int check_geometry(FILE *arq, unsigned int width, unsigned int height, unsigned short format, unsigned long long data_bytes, unsigned int *qt_blocks)
+{
+    unsigned long long pixels = (unsigned long long) width * height, bits = 0;
+    long here = ftell(arq), end = -1;
+    int err = -1;
+    if(here >= 0 && fseek(arq, 0, SEEK_END) == 0)
+    {
+        end = ftell(arq);
+        fseek(arq, here, SEEK_SET);
+    }
+    if(end > here) bits = (unsigned long long) (end - here) * 8;
+    if(data_bytes > 0 && (data_bytes * 8) < bits) bits = data_bytes * 8;
+    // Every block takes a symbol of each channel, at least a bit in Huffman and 1 / RANS_TOTAL of a bit in rANS, and a whole word in the words format
+    if(format == FORMAT_RANS) bits *= RANS_TOTAL;
+    else if(format == FORMAT_WORDS) bits /= 64;
+    if((pixels * 3) <= (0xFFFFFFFFULL - BMP_HEADER_SIZE) && ((pixels / 64) * 3) <= bits)
+    {
+        *qt_blocks = (unsigned int) (pixels / 64);
+        err = 0;
+    }
+    return err;
+}
+
+void end_word(BUFFER *b, BIT_WRITER *out)
+{
+    b->buffer = (b->buffer << 8) | 0xFF; // Put the EOB prefix
+    b->remaining_bits -= 8;
+    b->buffer <<= b->remaining_bits;
+    bit_writer_word(out, b->buffer);
+    b->buffer = 0;
+    b->remaining_bits = 64;
+}
+
+void write_in(double *block, BIT_WRITER *out)
+{
+    BUFFER b;
+    b.buffer = 0;
+    b.remaining_bits = 64;
+    unsigned long aux = 0;
     unsigned char zero_qt = 0, tmp_byte = 0x00;
     int x = 0, y = 1, max = 2;
-    fill_buffer(&b, (int) block[0][0]);
+    fill_buffer(&b, (int) block[(0 * 8) + 0]);
 
     for(int i = 1; i < 8; i++, max++)
     {
         for(int j = 1; j < max; j++)
         {
-            if(block[x][y] == 0)
+            if(block[(x * 8) + y] == 0)
             {
                 zero_qt++;
             }
@@ -1238,37 +2379,22 @@ void write_in(double **block, FILE *arq)
                         fill_buffer(&b, 0);
                         if(fill_buffer(&b, zero_qt) != 0)
                         {
-                            b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                            b.remaining_bits -= 8;
-                            b.buffer <<= b.remaining_bits;
-                            fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                            b.buffer = 0;
-                            b.remaining_bits = 64;
+                            end_word(&b, out);
                             fill_buffer(&b, zero_qt);
                         }
                     }
                     else 
                     {
-                        b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                        b.remaining_bits -= 8;
-                        b.buffer = b.buffer << b.remaining_bits;
-                        fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                        b.buffer = 0;
-                        b.remaining_bits = 64;
+                        end_word(&b, out);
                         fill_buffer(&b, 0);
                         fill_buffer(&b, zero_qt);
                     }
                     zero_qt = 0;
                 }
-                if(fill_buffer(&b, (int) block[x][y]) != 0)
+                if(fill_buffer(&b, (int) block[(x * 8) + y]) != 0)
                 {
-                    b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                    b.remaining_bits -= 8;
-                    b.buffer <<= b.remaining_bits;
-                    fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                    b.buffer = 0;
-                    b.remaining_bits = 64;
-                    fill_buffer(&b, (int) block[x][y]);
+                    end_word(&b, out);
+                    fill_buffer(&b, (int) block[(x * 8) + y]);
                 }
             }
             
@@ -1284,7 +2410,7 @@ void write_in(double **block, FILE *arq)
             }
         }
         
-        if(block[x][y] == 0)
+        if(block[(x * 8) + y] == 0)
         {
             zero_qt++;
         }
@@ -1297,37 +2423,22 @@ void write_in(double **block, FILE *arq)
                     fill_buffer(&b, 0);
                     if(fill_buffer(&b, zero_qt) != 0)
                     {
-                        b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                        b.remaining_bits -= 8;
-                        b.buffer <<= b.remaining_bits;
-                        fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                        b.buffer = 0;
-                        b.remaining_bits = 64;
+                        end_word(&b, out);
                         fill_buffer(&b, zero_qt);
                     }
                 }
                 else 
                 {
-                    b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                    b.remaining_bits -= 8;
-                    b.buffer = b.buffer << b.remaining_bits;
-                    fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                    b.buffer = 0;
-                    b.remaining_bits = 64;
+                    end_word(&b, out);
                     fill_buffer(&b, 0);
                     fill_buffer(&b, zero_qt);
                 }
                 zero_qt = 0;
             }
-            if(fill_buffer(&b, (int) block[x][y]) != 0)
+            if(fill_buffer(&b, (int) block[(x * 8) + y]) != 0)
             {
-                b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                b.remaining_bits -= 8;
-                b.buffer <<= b.remaining_bits;
-                fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                b.buffer = 0;
-                b.remaining_bits = 64;
-                fill_buffer(&b, (int) block[x][y]);
+                end_word(&b, out);
+                fill_buffer(&b, (int) block[(x * 8) + y]);
             }
         }
 
@@ -1348,7 +2459,7 @@ void write_in(double **block, FILE *arq)
     {
         for(int j = 0; j < max; j++)
         {
-            if(block[x][y] == 0)
+            if(block[(x * 8) + y] == 0)
             {
                 zero_qt++;
             }
@@ -1361,37 +2472,22 @@ void write_in(double **block, FILE *arq)
                         fill_buffer(&b, 0);
                         if(fill_buffer(&b, zero_qt) != 0)
                         {
-                            b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                            b.remaining_bits -= 8;
-                            b.buffer <<= b.remaining_bits;
-                            fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                            b.buffer = 0;
-                            b.remaining_bits = 64;
+                            end_word(&b, out);
                             fill_buffer(&b, zero_qt);
                         }
                     }
                     else 
                     {
-                        b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                        b.remaining_bits -= 8;
-                        b.buffer = b.buffer << b.remaining_bits;
-                        fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                        b.buffer = 0;
-                        b.remaining_bits = 64;
+                        end_word(&b, out);
                         fill_buffer(&b, 0);
                         fill_buffer(&b, zero_qt);
                     }
                     zero_qt = 0;
                 }
-                if(fill_buffer(&b, (int) block[x][y]) != 0)
+                if(fill_buffer(&b, (int) block[(x * 8) + y]) != 0)
                 {
-                    b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                    b.remaining_bits -= 8;
-                    b.buffer <<= b.remaining_bits;
-                    fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                    b.buffer = 0;
-                    b.remaining_bits = 64;
-                    fill_buffer(&b, (int) block[x][y]);
+                    end_word(&b, out);
+                    fill_buffer(&b, (int) block[(x * 8) + y]);
                 }
             }
 
@@ -1407,7 +2503,7 @@ void write_in(double **block, FILE *arq)
             }
         }
 
-        if(block[x][y] == 0)
+        if(block[(x * 8) + y] == 0)
         {
             zero_qt++;
         }
@@ -1420,37 +2516,22 @@ void write_in(double **block, FILE *arq)
                     fill_buffer(&b, 0);
                     if(fill_buffer(&b, zero_qt) != 0)
                     {
-                        b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                        b.remaining_bits -= 8;
-                        b.buffer <<= b.remaining_bits;
-                        fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                        b.buffer = 0;
-                        b.remaining_bits = 64;
+                        end_word(&b, out);
                         fill_buffer(&b, zero_qt);
                     }
                 }
                 else 
                 {
-                    b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                    b.remaining_bits -= 8;
-                    b.buffer = b.buffer << b.remaining_bits;
-                    fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                    b.buffer = 0;
-                    b.remaining_bits = 64;
+                    end_word(&b, out);
                     fill_buffer(&b, 0);
                     fill_buffer(&b, zero_qt);
                 }
                 zero_qt = 0;
             }
-            if(fill_buffer(&b, (int) block[x][y]) != 0)
+            if(fill_buffer(&b, (int) block[(x * 8) + y]) != 0)
             {
-                b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                b.remaining_bits -= 8;
-                b.buffer <<= b.remaining_bits;
-                fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-                b.buffer = 0;
-                b.remaining_bits = 64;
-                fill_buffer(&b, (int) block[x][y]);
+                end_word(&b, out);
+                fill_buffer(&b, (int) block[(x * 8) + y]);
             }
         }
 
@@ -1464,7 +2545,7 @@ void write_in(double **block, FILE *arq)
         }
     }
 
-    if(block[x][y] == 0)
+    if(block[(x * 8) + y] == 0)
     {
         zero_qt++;
         if(b.remaining_bits >= 11)
@@ -1472,276 +2553,978 @@ void write_in(double **block, FILE *arq)
             fill_buffer(&b, 0);
             if(fill_buffer(&b, zero_qt) != 0)
             {
-                b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-                b.remaining_bits -= 8;
-                b.buffer <<= b.remaining_bits;
-                fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);  
-                b.buffer = 0;
-                b.remaining_bits = 64;
+                end_word(&b, out);
                 fill_buffer(&b, zero_qt);
             }
         }
         else 
         {
-            b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-            b.remaining_bits -= 8;
-            b.buffer <<= b.remaining_bits;
-            fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);  
-            b.buffer = 0;
-            b.remaining_bits = 64;
+            end_word(&b, out);
             fill_buffer(&b, 0);
             fill_buffer(&b, zero_qt);
         }
     }
     else
     {
-        if(fill_buffer(&b, (int) block[x][y]) != 0)
+        if(fill_buffer(&b, (int) block[(x * 8) + y]) != 0)
         {
-            b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-            b.remaining_bits -= 8;
-            b.buffer <<= b.remaining_bits;
-            fwrite(&(b.buffer), sizeof(unsigned long), 1, arq);
-            b.buffer = 0;
-            b.remaining_bits = 64;
-            fill_buffer(&b, (int) block[x][y]);
+            end_word(&b, out);
+            fill_buffer(&b, (int) block[(x * 8) + y]);
         }
     }
-    b.buffer = (b.buffer << 8) | 0xFF; // Put the EOB prefix
-    b.remaining_bits -= 8;
-    b.buffer = b.buffer << b.remaining_bits;
-    fwrite(&b.buffer, sizeof(unsigned long), 1, arq);
+    end_word(&b, out);
 }
 
-void read_of(FILE *arq, double **vet)
+void put_value(BIT_WRITER *out, int value)
 {
-    unsigned long buffer = 0;
-    int x = 0, y = 1, max = 2, rec_block[64], value = EOB, zero_qt = 0, ptr_rec_block = 0;
-    fread(&buffer, sizeof(unsigned long), 1, arq);
-    while(1)
+    if(value > STREAM_LIMIT) value = STREAM_LIMIT;
+    if(value < -STREAM_LIMIT) value = -STREAM_LIMIT;
+    bit_writer_bits(out, HUFFMAN_TABLE[value + HUFFMAN_RANGE].code, HUFFMAN_TABLE[value + HUFFMAN_RANGE].length);
+}
+
+void write_stream(double *block, BIT_WRITER *out)
+{
+    int last = 0, zero_qt = 0, value = 0;
+    // The coefficients after the last one not zero are left to the EOB
+    for(int k = 1; k < 64; k++)
+    {
+        if(((int) block[ZIGZAG[k]]) != 0) last = k;
+    }
+    put_value(out, (int) block[0]); // The DC is always coded, even when it is zero
+    for(int k = 1; k <= last; k++)
     {
-        if(feof(arq) != 0 || ptr_rec_block >= 64)
+        value = (int) block[ZIGZAG[k]];
+        if(value == 0)
         {
-            break;
+            zero_qt++;
         }
-        else 
+        else
         {
-            if(buffer == 0 && ptr_rec_block < 63)
-            {
-                fread(&buffer, sizeof(unsigned long), 1, arq);
-            }
-            else 
+            if(zero_qt > 0) // A run of zeros is a zero followed by its length
             {
-                value = extract_value(&buffer);
-                if(value == 0)
-                {
-                    zero_qt = extract_value(&buffer);
-                    if(zero_qt == EOB)
-                    {
-                        fread(&buffer, sizeof(unsigned long), 1, arq);
-                        zero_qt = extract_value(&buffer);
-                    }
-                    while(zero_qt > 0 && ptr_rec_block < 64)
-                    {
-                        rec_block[ptr_rec_block] = value;
-                        ptr_rec_block++;
-                        zero_qt--;
-                    }
-                }
-                else if(value != EOB)
-                {
-                    rec_block[ptr_rec_block] = value;
-                    ptr_rec_block++;
-                }
+                put_value(out, 0);
+                put_value(out, zero_qt);
+                zero_qt = 0;
             }
+            put_value(out, value);
         }
     }
+    if(last < 63)
+    {
+        bit_writer_bits(out, EOB_CODE, EOB_LENGTH);
+    }
+}
 
-    ptr_rec_block = 0;
-    vet[0][0] = rec_block[ptr_rec_block++];
-    for(int i = 1; i < 8; i++, max++)
+void read_stream(BIT_READER *in, double *block)
+{
+    unsigned char length = 0;
+    int value = 0, zero_qt = 0, k = 1;
+    block[0] = decode_symbol(in->window, &length);
+    bit_reader_skip(in, length);
+    while(k < 64)
     {
-        for(int j = 1; j < max; j++)
+        value = decode_symbol(in->window, &length);
+        bit_reader_skip(in, length);
+        if(value == EOB)
         {
-            vet[x][y] = rec_block[ptr_rec_block++];
-            if((i % 2) == 0)
+            break;
+        }
+        else if(value == 0)
+        {
+            zero_qt = decode_symbol(in->window, &length);
+            bit_reader_skip(in, length);
+            while(zero_qt > 0 && k < 64)
             {
-                x--;
-                y++;
+                block[ZIGZAG[k++]] = 0;
+                zero_qt--;
             }
-            else 
+        }
+        else
+        {
+            block[ZIGZAG[k++]] = value;
+        }
+    }
+    while(k < 64)
+    {
+        block[ZIGZAG[k++]] = 0;
+    }
+}
+
+void build_symbol_table(SYMBOL_TABLE *table, const unsigned char *bits, const unsigned char *values)
+{
+    unsigned int code = 0, k = 0, first = 0;
+    memcpy(table->bits, bits, MAX_CODE_LENGTH + 1);
+    memset(table->codes, 0, sizeof(table->codes));
+    memset(table->lookup, 0, sizeof(table->lookup));
+    // Codes of the same length are consecutive, and each length starts at the double of where the previous one ended
+    for(int length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        table->offset[length] = (int) k - (int) code;
+        for(int i = 0; i < bits[length]; i++, k++, code++)
+        {
+            table->values[k] = values[k];
+            table->codes[values[k]].code = code;
+            table->codes[values[k]].length = length;
+            if(length <= LOOKAHEAD_BITS)
             {
-                x++;
-                y--;
+                first = code << (LOOKAHEAD_BITS - length);
+                for(unsigned int p = 0; p < (1U << (LOOKAHEAD_BITS - length)); p++)
+                {
+                    table->lookup[first + p].value = values[k];
+                    table->lookup[first + p].length = length;
+                }
             }
         }
-        
-        vet[x][y] = rec_block[ptr_rec_block++];
-        // Logic Here
-        if((i % 2) == 0)
+        table->max_code[length] = (bits[length] > 0) ? (int) (code - 1) : -1;
+        code <<= 1;
+    }
+    table->max_code[MAX_CODE_LENGTH + 1] = 0x7FFFFFFF; // Stops the search on a corrupted stream
+}
+
+void init_symbol_tables()
+{
+    static int ready = 0;
+    if(ready == 0)
+    {
+        build_symbol_table(&DC_TABLE[0], DC_LUMINANCE_BITS, DC_VALUES);
+        build_symbol_table(&DC_TABLE[1], DC_CHROMI_BITS, DC_VALUES);
+        build_symbol_table(&AC_TABLE[0], AC_LUMINANCE_BITS, AC_LUMINANCE_VALUES);
+        build_symbol_table(&AC_TABLE[1], AC_CHROMI_BITS, AC_CHROMI_VALUES);
+        for(int value = 1, size = 0; value <= DC_LIMIT; value++)
         {
-            y++;
+            if((value >> size) != 0) size++;
+            MAGNITUDE_BITS[value] = size;
         }
-        else 
+        ready = 1;
+    }
+}
+
+void put_symbol(BIT_WRITER *out, const SYMBOL_TABLE *table, unsigned char symbol, int value)
+{
+    unsigned char size = symbol & 0x0F;
+    if(value < 0) value += (1 << size) - 1; // Negative numbers are stored as the complement of their magnitude
+    bit_writer_bits(out, (table->codes[symbol].code << size) | (value & ((1 << size) - 1)), table->codes[symbol].length + size);
+}
+
+int get_symbol(BIT_READER *in, const SYMBOL_TABLE *table, int *value)
+{
+    HUFFMAN_SYMBOL symbol = table->lookup[in->window >> (64 - LOOKAHEAD_BITS)];
+    unsigned char length = symbol.length, size = 0;
+    int code = 0;
+    if(length == 0) // Longer than LOOKAHEAD_BITS, the canonical codes are searched length by length
+    {
+        length = LOOKAHEAD_BITS + 1;
+        code = (int) (in->window >> (64 - length));
+        while(code > table->max_code[length])
         {
-            x++;
+            length++;
+            code = (int) (in->window >> (64 - length));
+        }
+        if(length > MAX_CODE_LENGTH) // Corrupted stream, ends the block
+        {
+            bit_reader_skip(in, MAX_CODE_LENGTH);
+            *value = 0;
+            return SYMBOL_EOB;
         }
+        symbol.value = table->values[code + table->offset[length]];
+    }
+    size = symbol.value & 0x0F;
+    *value = 0;
+    if(size > 0)
+    {
+        *value = (int) ((in->window << length) >> (64 - size));
+        if(*value < (1 << (size - 1))) *value -= (1 << size) - 1;
     }
+    bit_reader_skip(in, length + size);
+    return symbol.value;
+}
 
-    // // Second half
-    max = 6;
-    x = 7;
-    y = 1;
-    for(int i = 1; i < 7; i++, max--)
+void write_run_size(double *block, const SYMBOL_TABLE *dc, const SYMBOL_TABLE *ac, BIT_WRITER *out)
+{
+    int value = (int) block[0], zero_qt = 0;
+    if(value > DC_LIMIT) value = DC_LIMIT;
+    if(value < -DC_LIMIT) value = -DC_LIMIT;
+    put_symbol(out, dc, MAGNITUDE_BITS[(value < 0) ? -value : value], value);
+    for(int k = 1; k < 64; k++)
     {
-        for(int j = 0; j < max; j++)
+        value = (int) block[ZIGZAG[k]];
+        if(value == 0)
         {
-            vet[x][y] = rec_block[ptr_rec_block++];
-            // Logic Here
-            if((i % 2) == 0)
+            zero_qt++;
+        }
+        else
+        {
+            while(zero_qt > 15)
             {
-                x++;
-                y--;
+                put_symbol(out, ac, SYMBOL_ZRL, 0);
+                zero_qt -= 16;
             }
-            else 
+            if(value > AC_LIMIT) value = AC_LIMIT;
+            if(value < -AC_LIMIT) value = -AC_LIMIT;
+            put_symbol(out, ac, (zero_qt << 4) | MAGNITUDE_BITS[(value < 0) ? -value : value], value);
+            zero_qt = 0;
+        }
+    }
+    if(zero_qt > 0)
+    {
+        put_symbol(out, ac, SYMBOL_EOB, 0);
+    }
+}
+
+void read_run_size(BIT_READER *in, const SYMBOL_TABLE *dc, const SYMBOL_TABLE *ac, double *block)
+{
+    int value = 0, symbol = 0, k = 1;
+    get_symbol(in, dc, &value);
+    block[0] = value;
+    while(k < 64)
+    {
+        symbol = get_symbol(in, ac, &value);
+        if(symbol == SYMBOL_EOB)
+        {
+            break;
+        }
+        // The run of zeros, then the value (a ZRL has no value, its 16th zero is written as one)
+        for(int zero_qt = symbol >> 4; zero_qt > 0 && k < 64; zero_qt--)
+        {
+            block[ZIGZAG[k++]] = 0;
+        }
+        if(k < 64)
+        {
+            block[ZIGZAG[k++]] = value;
+        }
+    }
+    while(k < 64)
+    {
+        block[ZIGZAG[k++]] = 0;
+    }
+}
+
+void count_run_size(double *block, unsigned long *dc_freq, unsigned long *ac_freq)
+{
+    int value = (int) block[0], zero_qt = 0;
+    if(value > DC_LIMIT) value = DC_LIMIT;
+    if(value < -DC_LIMIT) value = -DC_LIMIT;
+    dc_freq[MAGNITUDE_BITS[(value < 0) ? -value : value]]++;
+    for(int k = 1; k < 64; k++)
+    {
+        value = (int) block[ZIGZAG[k]];
+        if(value == 0)
+        {
+            zero_qt++;
+        }
+        else
+        {
+            while(zero_qt > 15)
             {
-                x--;
-                y++;
+                ac_freq[SYMBOL_ZRL]++;
+                zero_qt -= 16;
             }
+            if(value > AC_LIMIT) value = AC_LIMIT;
+            if(value < -AC_LIMIT) value = -AC_LIMIT;
+            ac_freq[(zero_qt << 4) | MAGNITUDE_BITS[(value < 0) ? -value : value]]++;
+            zero_qt = 0;
         }
-        vet[x][y] = rec_block[ptr_rec_block++];
-        // Logic Here
-        if((i % 2) == 0)
+    }
+    if(zero_qt > 0)
+    {
+        ac_freq[SYMBOL_EOB]++;
+    }
+}
+
+void optimal_table(const unsigned long *counts, unsigned char *bits, unsigned char *values)
+{
+    unsigned long freq[257], lowest = 0;
+    int code_size[257], others[257], tree_bits[MAX_TREE_LENGTH + 1], c1 = 0, c2 = 0, length = 0, k = 0;
+    memcpy(freq, counts, 256 * sizeof(unsigned long));
+    freq[256] = 1; // Reserves one code, so that no code is made only of ones
+    for(int i = 0; i < 257; i++)
+    {
+        code_size[i] = 0;
+        others[i] = -1;
+    }
+    memset(tree_bits, 0, sizeof(tree_bits));
+
+    // Huffman's algorithm, merging the two least frequent subtrees until one is left (JPEG Annex K.2)
+    while(1)
+    {
+        c1 = -1;
+        c2 = -1;
+        lowest = ~0UL;
+        for(int i = 0; i < 257; i++)
         {
-            y++;
+            if(freq[i] != 0 && freq[i] <= lowest)
+            {
+                lowest = freq[i];
+                c1 = i;
+            }
         }
-        else 
+        lowest = ~0UL;
+        for(int i = 0; i < 257; i++)
         {
-            x++;
+            if(freq[i] != 0 && freq[i] <= lowest && i != c1)
+            {
+                lowest = freq[i];
+                c2 = i;
+            }
+        }
+        if(c2 < 0) break;
+
+        freq[c1] += freq[c2];
+        freq[c2] = 0;
+        code_size[c1]++;
+        while(others[c1] >= 0)
+        {
+            c1 = others[c1];
+            code_size[c1]++;
+        }
+        others[c1] = c2;
+        code_size[c2]++;
+        while(others[c2] >= 0)
+        {
+            c2 = others[c2];
+            code_size[c2]++;
+        }
+    }
+    for(int i = 0; i < 257; i++)
+    {
+        if(code_size[i] > MAX_TREE_LENGTH) code_size[i] = MAX_TREE_LENGTH;
+        if(code_size[i] > 0) tree_bits[code_size[i]]++;
+    }
+
+    // Codes longer than MAX_CODE_LENGTH are moved up, a pair at a time, below a shorter code that becomes a prefix
+    for(int i = MAX_TREE_LENGTH; i > MAX_CODE_LENGTH; i--)
+    {
+        while(tree_bits[i] > 0)
+        {
+            length = i - 2;
+            while(length > 0 && tree_bits[length] == 0) length--;
+            tree_bits[i] -= 2;
+            tree_bits[i - 1]++;
+            tree_bits[length + 1] += 2;
+            tree_bits[length]--;
+        }
+    }
+    // Without symbols the reserved code is never merged and gets no size, so every length stays empty.
+    // A single symbol is merged with the reserved code only, and both get a 1 bit code
+    length = MAX_CODE_LENGTH;
+    while(length > 0 && tree_bits[length] == 0) length--;
+    if(length > 0) tree_bits[length]--; // Gives back the reserved code, the longest one
+
+    bits[0] = 0;
+    for(int i = 1; i <= MAX_CODE_LENGTH; i++)
+    {
+        bits[i] = (unsigned char) tree_bits[i];
+    }
+    // Shorter codes go to the more frequent symbols, in the order they were sized by the tree
+    for(int i = 1; i <= MAX_TREE_LENGTH; i++)
+    {
+        for(int j = 0; j < 256; j++)
+        {
+            if(code_size[j] == i) values[k++] = (unsigned char) j;
         }
     }
-    vet[x][y] = rec_block[ptr_rec_block++];
-    // Logic Here
 }
 
-int fill_buffer(BUFFER *buffer, int data)
+int optimize_tables(BMP_FILE *bmp)
 {
-    unsigned int cat = 0, huffman_encoded = 0;
-    int status = -1;
-    huffman_encoded = huffman_code(data); // Encodes data in huffman code
-    if(data == 1 || data == -1) // Category 1
+    unsigned long *freq = NULL; // Counts of the DC of luminance and chrominance then AC of both, 256 symbols each
+    unsigned char bits[MAX_CODE_LENGTH + 1], values[256];
+    unsigned int chunks = thread_pool_threads(bmp->pool) * COUNT_CHUNKS_BY_THREAD;
+    unsigned long symbols[4] = { 0, 0, 0, 0 };
+    COUNT_JOB job;
+    int err = 0;
+    if(bmp->tables == NULL)
+    {
+        bmp->tables = (SYMBOL_TABLE *) malloc(4 * sizeof(SYMBOL_TABLE));
+    }
+    job.bmp = bmp;
+    job.chunk = (bmp->channels.qt_blocks + chunks - 1) / chunks;
+    if(job.chunk == 0) job.chunk = 1;
+    freq = (unsigned long *) calloc(chunks * 4 * 256, sizeof(unsigned long));
+    job.freq = freq;
+    if(bmp->tables != NULL && freq != NULL)
     {
-        if(buffer->remaining_bits >= 12)
+        // Each chunk counts apart, the sums do not depend on how the blocks were split
+        thread_pool_run(bmp->pool, count_task, &job, bmp->channels.qt_blocks, job.chunk);
+        for(unsigned int k = 4 * 256; k < (chunks * 4 * 256); k++)
         {
-            buffer->buffer = (buffer->buffer << 4) | huffman_encoded;
-            buffer->remaining_bits -= 4;
-            status = 0;
+            freq[k % (4 * 256)] += freq[k];
+        }
+        for(unsigned int k = 0; k < (4 * 256); k++)
+        {
+            symbols[k / 256] += freq[k];
         }
     }
-    else if(data >= -7 && data <= -4) // Category 3
+    if(bmp->tables != NULL && freq != NULL && symbols[0] > 0 && symbols[1] > 0 && symbols[2] > 0 && symbols[3] > 0)
     {
-        if(buffer->remaining_bits >= 13)
+        for(int t = 0; t < 4; t++)
         {
-            buffer->buffer = (buffer->buffer << 5) | huffman_encoded;
-            buffer->remaining_bits -= 5;
-            status = 0;
+            optimal_table(freq + (t * 256), bits, values);
+            build_symbol_table(&bmp->tables[t], bits, values);
+        }
+    }
+    else if(bmp->tables != NULL && freq != NULL)
+    {
+        // An image without blocks has nothing to count, the standard tables are written instead
+        free(bmp->tables);
+        bmp->tables = NULL;
+        bmp->format = FORMAT_RUN_SIZE;
+        err = -1;
+    }
+    else
+    {
+        // Without memory for the tables the image is written with the standard ones, the file is still whole so ERROR is left alone and only the -1 tells it
+        free(bmp->tables);
+        bmp->tables = NULL;
+        bmp->format = FORMAT_RUN_SIZE;
+        err = -1;
+    }
+    free(freq);
+    return err;
+}
+
+void count_task(void *arg, unsigned int first, unsigned int count)
+{
+    COUNT_JOB *job = (COUNT_JOB *) arg;
+    double *channels[3] = { job->bmp->channels.y, job->bmp->channels.cb, job->bmp->channels.cr };
+    unsigned long *freq = job->freq + ((first / job->chunk) * 4 * 256);
+    for(unsigned int i = first; i < (first + count); i++)
+    {
+        for(int c = 0; c < 3; c++)
+        {
+            count_run_size(channels[c] + (i * BLOCK_SIZE), freq + ((c != 0) * 256), freq + ((2 + (c != 0)) * 256));
         }
     }
-    else if(data >= 4 && data <= 7) // Category 3
+}
+
+void write_tables(const SYMBOL_TABLE *tables, BIT_WRITER *out)
+{
+    int count = 0;
+    for(int t = 0; t < 4; t++)
     {
-        if(buffer->remaining_bits >= 13)
+        count = 0;
+        for(int i = 1; i <= MAX_CODE_LENGTH; i++)
         {
-            buffer->buffer = (buffer->buffer << 5) | huffman_encoded;
-            buffer->remaining_bits -= 5;
-            status = 0;
+            bit_writer_bits(out, tables[t].bits[i], 8);
+            count += tables[t].bits[i];
+        }
+        for(int k = 0; k < count; k++)
+        {
+            bit_writer_bits(out, tables[t].values[k], 8);
         }
     }
-    else
+}
+
+int read_tables(BIT_READER *in, SYMBOL_TABLE *tables)
+{
+    unsigned char bits[MAX_CODE_LENGTH + 1], values[256];
+    unsigned int code = 0;
+    int count = 0, err = 0;
+    for(int t = 0; err == 0 && t < 4; t++)
+    {
+        count = 0;
+        code = 0;
+        bits[0] = 0;
+        for(int i = 1; i <= MAX_CODE_LENGTH; i++)
+        {
+            bits[i] = (unsigned char) (in->window >> 56);
+            bit_reader_skip(in, 8);
+            count += bits[i];
+            // The codes of each length must fit in its bits (Kraft inequality), as build_symbol_table assigns them
+            code = (code << 1) + bits[i];
+            if(code > (1U << i)) err = -1;
+        }
+        if(count > 256) err = -1;
+        for(int k = 0; err == 0 && k < count; k++)
+        {
+            values[k] = (unsigned char) (in->window >> 56);
+            bit_reader_skip(in, 8);
+        }
+        if(err == 0) build_symbol_table(&tables[t], bits, values);
+    }
+    if(err != 0) ERROR = ERR_CORRUPTED_FILE;
+    return err;
+}
+
+void init_rans_context(RANS_CONTEXT *context)
+{
+    for(int c = 0; c < 2; c++)
+    {
+        rans_model_init(&context->dc[c], 12);
+        for(int k = 0; k < 63; k++)
+        {
+            rans_model_init(&context->ac[c][k], 12);
+        }
+    }
+}
+
+void put_rans_value(RANS_ENCODER *encoder, RANS_MODEL *model, int value, int limit)
+{
+    unsigned char size = 0;
+    if(value > limit) value = limit;
+    if(value < -limit) value = -limit;
+    size = MAGNITUDE_BITS[(value < 0) ? -value : value];
+    rans_encode(encoder, model, size);
+    if(value < 0) value += (1 << size) - 1; // Negative numbers are stored as the complement of their magnitude
+    rans_encode_bits(encoder, value & ((1 << size) - 1), size);
+}
+
+int get_rans_value(RANS_DECODER *decoder, RANS_MODEL *model, int *value)
+{
+    int size = rans_decode(decoder, model);
+    *value = 0;
+    if(size > 0 && size != RANS_EOB)
+    {
+        *value = (int) rans_decode_bits(decoder, size);
+        if(*value < (1 << (size - 1))) *value -= (1 << size) - 1;
+    }
+    return size;
+}
+
+void write_rans(double *block, RANS_MODEL *dc, RANS_MODEL *ac, RANS_ENCODER *encoder)
+{
+    int last = 0;
+    for(int k = 1; k < 64; k++)
+    {
+        if(((int) block[ZIGZAG[k]]) != 0) last = k;
+    }
+    put_rans_value(encoder, dc, (int) block[0], DC_LIMIT);
+    // Every position up to the last coefficient not zero codes its size, zeros included, in the model of the position
+    for(int k = 1; k <= last; k++)
     {
-        // huffman_encoded = huffman_code(data);
-        cat = category(huffman_encoded);
-        if(cat == 0)
+        put_rans_value(encoder, &ac[k - 1], (int) block[ZIGZAG[k]], AC_LIMIT);
+    }
+    if(last < 63)
+    {
+        rans_encode(encoder, &ac[last], RANS_EOB);
+    }
+}
+
+void read_rans(RANS_DECODER *decoder, RANS_MODEL *dc, RANS_MODEL *ac, double *block)
+{
+    int value = 0, k = 1;
+    get_rans_value(decoder, dc, &value);
+    block[0] = value;
+    for(; k < 64; k++)
+    {
+        if(get_rans_value(decoder, &ac[k - 1], &value) == RANS_EOB)
         {
-            if(buffer->remaining_bits >= 11) // The necessary bits plus EOB prefix
+            break;
+        }
+        block[ZIGZAG[k]] = value;
+    }
+    for(; k < 64; k++)
+    {
+        block[ZIGZAG[k]] = 0;
+    }
+}
+
+int compress_rans(BMP_FILE *bmp, unsigned int first, unsigned int count, BIT_WRITER *out)
+{
+    RANS_CONTEXT *context = (RANS_CONTEXT *) malloc(sizeof(RANS_CONTEXT));
+    RANS_ENCODER encoder;
+    double *channels[3] = { bmp->channels.y, bmp->channels.cb, bmp->channels.cr };
+    unsigned char *data = NULL;
+    size_t size = 0;
+    int err = -1;
+    if(context != NULL && rans_encoder_open(&encoder) == 0)
+    {
+        // The models run forward while the symbols are recorded, then rANS codes them backwards
+        init_rans_context(context);
+        for(unsigned int i = first; i < (first + count); i++)
+        {
+            for(int c = 0; c < 3; c++)
             {
-                buffer->buffer = (buffer->buffer << 3) | huffman_encoded;
-                buffer->remaining_bits -= 3;
-                status = 0;
+                write_rans(channels[c] + (i * BLOCK_SIZE), context->dc + (c != 0), context->ac[c != 0], &encoder);
             }
         }
-        else if(cat == 2)
+        data = rans_encoder_finish(&encoder, &size);
+        if(data != NULL)
         {
-            if(buffer->remaining_bits >= 13)
+            bit_writer_bits(out, (unsigned int) size, 32);
+            for(size_t k = 0; k < size; k++)
             {
-                buffer->buffer = (buffer->buffer << 5) | huffman_encoded;
-                buffer->remaining_bits -= 5;
-                status = 0;
+                bit_writer_bits(out, data[k], 8);
             }
+            free(data);
+            err = 0;
         }
-        else if(cat == 4)
+        rans_encoder_close(&encoder);
+    }
+    else
+    {
+        ERROR = ERR_ALLOCATE_MEMORY;
+    }
+    free(context);
+    return err;
+}
+
+int decompress_rans(BMP_FILE *bmp, unsigned int first, unsigned int count, BIT_READER *in)
+{
+    RANS_CONTEXT *context = (RANS_CONTEXT *) malloc(sizeof(RANS_CONTEXT));
+    RANS_DECODER decoder;
+    double *channels[3] = { bmp->channels.y, bmp->channels.cb, bmp->channels.cr };
+    size_t size = 0, start = 0;
+    int err = -1;
+    size = (size_t) (in->window >> 32);
+    bit_reader_skip(in, 32);
+    start = bit_reader_tell(in) / 8;
+    if(context != NULL)
+    {
+        if(start + size > in->size) // A short file decodes zeros past its end
+        {
+            size = (start < in->size) ? (in->size - start) : 0;
+        }
+        init_rans_context(context);
+        rans_decoder_open(&decoder, in->data + start, size);
+        for(unsigned int i = first; i < (first + count); i++)
         {
-            if(buffer->remaining_bits >= 15)
+            for(int c = 0; c < 3; c++)
             {
-                buffer->buffer = (buffer->buffer << 7) | huffman_encoded;
-                buffer->remaining_bits -= 7;
-                status = 0;
+                read_rans(&decoder, context->dc + (c != 0), context->ac[c != 0], channels[c] + (i * BLOCK_SIZE));
             }
         }
-        else if(cat == 5)
+        err = 0;
+    }
+    else
+    {
+        ERROR = ERR_ALLOCATE_MEMORY;
+    }
+    free(context);
+    return err;
+}
+
+void encode_blocks(BMP_FILE *bmp, unsigned int first, unsigned int count, BIT_WRITER *out)
+{
+    double *channels[3] = { bmp->channels.y, bmp->channels.cb, bmp->channels.cr };
+    double *block = NULL;
+    const SYMBOL_TABLE *dc = (bmp->tables != NULL) ? bmp->tables : DC_TABLE;
+    const SYMBOL_TABLE *ac = (bmp->tables != NULL) ? (bmp->tables + 2) : AC_TABLE;
+    if(bmp->format == FORMAT_RANS) // rANS codes the whole range as one unit
+    {
+        compress_rans(bmp, first, count, out);
+    }
+    else
+    {
+        for(unsigned int i = first; i < (first + count); i++)
         {
-            if(buffer->remaining_bits >= 16)
+            for(int c = 0; c < 3; c++)
             {
-                buffer->buffer = (buffer->buffer << 8) | huffman_encoded;
-                buffer->remaining_bits -= 8;
-                status = 0;
+                block = channels[c] + (i * BLOCK_SIZE);
+                if(bmp->format == FORMAT_RUN_SIZE || bmp->format == FORMAT_OPTIMIZED)
+                {
+                    write_run_size(block, &dc[c != 0], &ac[c != 0], out);
+                }
+                else if(bmp->format == FORMAT_STREAM)
+                {
+                    write_stream(block, out);
+                }
+                else
+                {
+                    write_in(block, out);
+                }
             }
         }
-        else if(cat == 6)
+    }
+}
+
+void decode_blocks(BMP_FILE *bmp, unsigned int first, unsigned int count, BIT_READER *in)
+{
+    double *channels[3] = { bmp->channels.y, bmp->channels.cb, bmp->channels.cr };
+    double *block = NULL;
+    const SYMBOL_TABLE *dc = (bmp->tables != NULL) ? bmp->tables : DC_TABLE;
+    const SYMBOL_TABLE *ac = (bmp->tables != NULL) ? (bmp->tables + 2) : AC_TABLE;
+    if(bmp->format == FORMAT_RANS)
+    {
+        decompress_rans(bmp, first, count, in);
+    }
+    else
+    {
+        for(unsigned int i = first; i < (first + count); i++)
         {
-            if(buffer->remaining_bits >= 18)
+            for(int c = 0; c < 3; c++)
             {
-                buffer->buffer = (buffer->buffer << 10) | huffman_encoded;
-                buffer->remaining_bits -= 10;
-                status = 0;
+                block = channels[c] + (i * BLOCK_SIZE);
+                if(bmp->format == FORMAT_RUN_SIZE || bmp->format == FORMAT_OPTIMIZED)
+                {
+                    read_run_size(in, &dc[c != 0], &ac[c != 0], block);
+                }
+                else if(bmp->format == FORMAT_STREAM)
+                {
+                    read_stream(in, block);
+                }
+                else
+                {
+                    read_of(in, block);
+                }
             }
         }
-        else if(cat == 7)
-        {
-            if(buffer->remaining_bits >= 20)
+    }
+}
+
+unsigned int segment_count(const BMP_FILE *bmp)
+{
+    unsigned int count = 1;
+    if(bmp->segment_blocks > 0 && bmp->channels.qt_blocks > 0)
+    {
+        count = (bmp->channels.qt_blocks + bmp->segment_blocks - 1) / bmp->segment_blocks;
+    }
+    return count;
+}
+
+unsigned int segment_length(const BMP_FILE *bmp, unsigned int segment)
+{
+    unsigned int first = segment * bmp->segment_blocks;
+    return (bmp->segment_blocks > 0 && (bmp->channels.qt_blocks - first) > bmp->segment_blocks) ? bmp->segment_blocks : (bmp->channels.qt_blocks - first);
+}
+
+void encode_segments(BMP_FILE *bmp, unsigned int *offsets, unsigned int *index, BIT_WRITER *out)
+{
+    SLICE_JOB job;
+    unsigned int count = segment_count(bmp), threads = thread_pool_threads(bmp->pool), batch = 0;
+    job.bmp = bmp;
+    job.slices = NULL;
+    job.index = index;
+    if(count > 1 && threads > 1)
+    {
+        batch = SLICE_BATCH_BLOCKS / bmp->segment_blocks;
+        if(batch < (threads * SLICES_BY_THREAD)) batch = threads * SLICES_BY_THREAD;
+        if(batch > count) batch = count;
+        job.slices = (BIT_WRITER *) malloc(batch * sizeof(BIT_WRITER));
+    }
+    if(job.slices != NULL)
+    {
+        // The segments of a batch are coded in parallel, then appended in order where the serial loop would have written them
+        for(job.first = 0; job.first < count; job.first += job.count)
+        {
+            job.count = ((count - job.first) < batch) ? (count - job.first) : batch;
+            thread_pool_run(bmp->pool, encode_slice_task, &job, job.count, 1);
+            for(unsigned int k = 0; k < job.count; k++)
             {
-                buffer->buffer = (buffer->buffer << 12) | huffman_encoded;
-                buffer->remaining_bits -= 12;
-                status = 0;
+                bit_writer_align(out);
+                offsets[job.first + k] = (unsigned int) (bit_writer_tell(out) / 8);
+                bit_writer_bytes(out, job.slices[k].data, job.slices[k].size);
+                bit_writer_close(&job.slices[k]);
             }
         }
-        else if(cat == 8)
+        free(job.slices);
+    }
+    else
+    {
+        for(unsigned int k = 0; k < count; k++)
+        {
+            // Every segment starts on a byte, its DC predictions restart from zero (see bmp_diff_encode)
+            bit_writer_align(out);
+            if(offsets != NULL) offsets[k] = (unsigned int) (bit_writer_tell(out) / 8);
+            encode_segment(bmp, k, index, out);
+        }
+    }
+}
+
+void encode_segment(BMP_FILE *bmp, unsigned int segment, unsigned int *index, BIT_WRITER *out)
+{
+    unsigned int first = segment * bmp->segment_blocks, count = segment_length(bmp, segment), run = 0;
+    size_t start = bit_writer_tell(out);
+    if(index == NULL)
+    {
+        encode_blocks(bmp, first, count, out);
+    }
+    else
+    {
+        // Entries are relative to the segment, so they hold inside the buffer of a segment coded in parallel too
+        for(unsigned int i = first; i < (first + count); i += run)
+        {
+            run = bmp->index_blocks - (i % bmp->index_blocks);
+            if(run > (first + count - i)) run = first + count - i;
+            if((i % bmp->index_blocks) == 0) index[i / bmp->index_blocks] = (unsigned int) (bit_writer_tell(out) - start);
+            encode_blocks(bmp, i, run, out);
+        }
+    }
+}
+
+void encode_slice_task(void *arg, unsigned int first, unsigned int count)
+{
+    SLICE_JOB *job = (SLICE_JOB *) arg;
+    unsigned int segment = 0;
+    for(unsigned int k = first; k < (first + count); k++)
+    {
+        segment = job->first + k;
+        if(bit_writer_open(&job->slices[k], NULL, (size_t) segment_length(job->bmp, segment) * BLOCK_SIZE) == 0)
+        {
+            encode_segment(job->bmp, segment, job->index, &job->slices[k]);
+            bit_writer_align(&job->slices[k]);
+        }
+    }
+}
+
+unsigned int *read_index(FILE *arq, unsigned int *blocks, unsigned int qt_blocks)
+{
+    unsigned int count = 0, *offsets = NULL;
+    fread(blocks, sizeof(unsigned int), 1, arq);
+    fread(&count, sizeof(unsigned int), 1, arq);
+    if(*blocks > 0 && count > 0 && count == index_count(qt_blocks, *blocks))
+    {
+        offsets = (unsigned int *) malloc(count * sizeof(unsigned int));
+        if(offsets == NULL)
+        {
+            ERROR = ERR_ALLOCATE_MEMORY;
+        }
+        else if(fread(offsets, sizeof(unsigned int), count, arq) != count)
+        {
+            free(offsets);
+            offsets = NULL;
+            ERROR = ERR_CORRUPTED_FILE;
+        }
+    }
+    else
+    {
+        ERROR = ERR_CORRUPTED_FILE;
+    }
+    return offsets;
+}
+
+unsigned int index_count(unsigned int qt_blocks, unsigned int blocks)
+{
+    return (qt_blocks + blocks - 1) / blocks;
+}
+
+void decode_unit_task(void *arg, unsigned int first, unsigned int count)
+{
+    DECODE_JOB *job = (DECODE_JOB *) arg;
+    BIT_READER in;
+    for(unsigned int k = first; k < (first + count); k++)
+    {
+        in = *job->in; // Only the position is copied, the data stays shared and is freed by the caller
+        bit_reader_seek(&in, job->units[k].bit);
+        decode_blocks(job->bmp, job->units[k].first, job->units[k].count, &in);
+    }
+}
+
+void read_of(BIT_READER *in, double *vet)
+{
+    unsigned long buffer = 0;
+    int x = 0, y = 1, max = 2, rec_block[64], value = EOB, zero_qt = 0, ptr_rec_block = 0;
+    buffer = bit_reader_word(in);
+    while(1)
+    {
+        if(bit_reader_tell(in) > (in->size * 8) || ptr_rec_block >= 64) // Stops on a word read past the end of the file
+        {
+            break;
+        }
+        else 
         {
-            if(buffer->remaining_bits >= 22)
+            if(buffer == 0 && ptr_rec_block < 63)
             {
-                buffer->buffer = (buffer->buffer << 14) | huffman_encoded;
-                buffer->remaining_bits -= 14;
-                status = 0;
+                buffer = bit_reader_word(in);
+            }
+            else 
+            {
+                value = extract_value(&buffer);
+                if(value == 0)
+                {
+                    zero_qt = extract_value(&buffer);
+                    if(zero_qt == EOB)
+                    {
+                        buffer = bit_reader_word(in);
+                        zero_qt = extract_value(&buffer);
+                    }
+                    while(zero_qt > 0 && ptr_rec_block < 64)
+                    {
+                        rec_block[ptr_rec_block] = value;
+                        ptr_rec_block++;
+                        zero_qt--;
+                    }
+                }
+                else if(value != EOB)
+                {
+                    rec_block[ptr_rec_block] = value;
+                    ptr_rec_block++;
+                }
             }
         }
-        else if(cat == 9)
+    }
+
+    ptr_rec_block = 0;
+    vet[(0 * 8) + 0] = rec_block[ptr_rec_block++];
+    for(int i = 1; i < 8; i++, max++)
+    {
+        for(int j = 1; j < max; j++)
         {
-            if(buffer->remaining_bits >= 24)
+            vet[(x * 8) + y] = rec_block[ptr_rec_block++];
+            if((i % 2) == 0)
             {
-                buffer->buffer = (buffer->buffer << 16) | huffman_encoded;
-                buffer->remaining_bits -= 16;
-                status = 0;
+                x--;
+                y++;
             }
+            else 
+            {
+                x++;
+                y--;
+            }
+        }
+        
+        vet[(x * 8) + y] = rec_block[ptr_rec_block++];
+        // Logic Here
+        if((i % 2) == 0)
+        {
+            y++;
         }
-        else if(cat == 10)
+        else 
         {
-            if(buffer->remaining_bits >= 26)
+            x++;
+        }
+    }
+
+    // // Second half
+    max = 6;
+    x = 7;
+    y = 1;
+    for(int i = 1; i < 7; i++, max--)
+    {
+        for(int j = 0; j < max; j++)
+        {
+            vet[(x * 8) + y] = rec_block[ptr_rec_block++];
+            // Logic Here
+            if((i % 2) == 0)
             {
-                buffer->buffer = (buffer->buffer << 18) | huffman_encoded;
-                buffer->remaining_bits -= 18;
-                status = 0;
+                x++;
+                y--;
             }
+            else 
+            {
+                x--;
+                y++;
+            }
+        }
+        vet[(x * 8) + y] = rec_block[ptr_rec_block++];
+        // Logic Here
+        if((i % 2) == 0)
+        {
+            y++;
+        }
+        else 
+        {
+            x++;
+        }
+    }
+    vet[(x * 8) + y] = rec_block[ptr_rec_block++];
+    // Logic Here
+}
+
+int fill_buffer(BUFFER *buffer, int data)
+{
+    unsigned int index = (unsigned int) (data + HUFFMAN_RANGE);
+    int status = -1;
+    if(index < HUFFMAN_ENTRIES) // Values out of the table have no code
+    {
+        // An entry of length 0 has no code either, and never fits
+        if(HUFFMAN_TABLE[index].length != 0 && buffer->remaining_bits >= (HUFFMAN_TABLE[index].length + 8)) // The necessary bits plus EOB prefix
+        {
+            buffer->buffer = (buffer->buffer << HUFFMAN_TABLE[index].length) | HUFFMAN_TABLE[index].code;
+            buffer->remaining_bits -= HUFFMAN_TABLE[index].length;
+            status = 0;
         }
     }
-    
     return status;
 }
 
@@ -1750,28 +3533,65 @@ BMP_CHANNELS *bmp_get_channels()
 
 }
 
+BMP_FILE *bmp_create()
+{
+    BMP_FILE *bmp = (BMP_FILE *) malloc(sizeof(BMP_FILE));
+    if(bmp != NULL)
+    {
+        bmp->channels.qt_blocks = 0;
+        bmp->channels.y = NULL;
+        bmp->channels.cb = NULL;
+        bmp->channels.cr = NULL;
+        bmp->dct_engine = DCT_REFERENCE;
+        bmp->format = FORMAT_WORDS;
+        bmp->predictor = PREDICT_ZIGZAG;
+        bmp->tables = NULL;
+        bmp->segment_blocks = 0;
+        bmp->index_blocks = 0;
+        bmp->pool = NULL;
+        bmp->shared_pool = 0;
+    }
+    return bmp;
+}
+
+int bmp_alloc_channels(BMP_FILE *bmp)
+{
+    void *arena = NULL;
+    size_t channel_size = (size_t) bmp->channels.qt_blocks * BLOCK_SIZE;
+    int err = 0;
+#ifdef _WIN32
+    arena = _aligned_malloc(sizeof(double) * 3 * channel_size, ARENA_ALIGN);
+#else
+    if(posix_memalign(&arena, ARENA_ALIGN, sizeof(double) * 3 * channel_size) != 0) arena = NULL;
+#endif
+    bmp->channels.y = (double *) arena;
+    bmp->channels.cb = NULL;
+    bmp->channels.cr = NULL;
+    if(arena != NULL)
+    {
+        bmp->channels.cb = bmp->channels.y + channel_size;
+        bmp->channels.cr = bmp->channels.cb + channel_size;
+    }
+    else if(channel_size > 0) // An image without blocks needs no memory
+    {
+        ERROR = ERR_ALLOCATE_MEMORY;
+        err = -1;
+    }
+    return err;
+}
+
 void bmp_free_channels(BMP_FILE **bmp)
 {
     if((*bmp) != NULL)
     {
-        for(int i = 0; i < (*bmp)->channels.qt_blocks; i++)
-        {
-            for(int j = 0; j < 8; j++)
-            {
-                free((*bmp)->channels.y[i][j]);
-                free((*bmp)->channels.cb[i][j]);
-                free((*bmp)->channels.cr[i][j]);
-            }
-            free((*bmp)->channels.y[i]);
-            free((*bmp)->channels.cb[i]);
-            free((*bmp)->channels.cr[i]);
-            (*bmp)->channels.y[i] = NULL;
-            (*bmp)->channels.cb[i] = NULL;
-            (*bmp)->channels.cr[i] = NULL;
-        }
+#ifdef _WIN32
+        _aligned_free((*bmp)->channels.y);
+#else
         free((*bmp)->channels.y);
-        free((*bmp)->channels.cb);
-        free((*bmp)->channels.cr);
+#endif
+        (*bmp)->channels.y = NULL;
+        (*bmp)->channels.cb = NULL;
+        (*bmp)->channels.cr = NULL;
     }
 }
 
@@ -1780,23 +3600,25 @@ void bmp_destroy(BMP_FILE **bmp)
     if((*bmp) != NULL)
     {
         bmp_free_channels(bmp);
+        if((*bmp)->shared_pool == 0) thread_pool_destroy(&(*bmp)->pool);
+        free((*bmp)->tables);
         free((*bmp));
         (*bmp) = NULL;
     }
 }
 
 
-void print_zigzag(double **arr)
+void print_zigzag(double *arr)
 {
     int x = 0, y = 1, max = 2;
 
     // First half
-    printf("%.0lf\n", arr[0][0]);
+    printf("%.0lf\n", arr[(0 * 8) + 0]);
     for(int i = 1; i < 8; i++, max++)
     {
         for(int j = 1; j < max; j++)
         {
-            printf("%.0lf ", arr[x][y]);
+            printf("%.0lf ", arr[(x * 8) + y]);
             if((i % 2) == 0)
             {
                 x--;
@@ -1810,7 +3632,7 @@ void print_zigzag(double **arr)
 
         }
         
-        printf("%.0lf\n", arr[x][y]);
+        printf("%.0lf\n", arr[(x * 8) + y]);
         if((i % 2) == 0)
         {
             y++;
@@ -1828,7 +3650,7 @@ void print_zigzag(double **arr)
     {
         for(int j = 0; j < max; j++)
         {
-            printf("%.0lf ", arr[x][y]);
+            printf("%.0lf ", arr[(x * 8) + y]);
             if((i % 2) == 0)
             {
                 x++;
@@ -1840,7 +3662,7 @@ void print_zigzag(double **arr)
                 y++;
             }
         }
-        printf("%.0lf\n", arr[x][y]);
+        printf("%.0lf\n", arr[(x * 8) + y]);
         if((i % 2) == 0)
         {
             y++;
@@ -1850,7 +3672,7 @@ void print_zigzag(double **arr)
             x++;
         }
     }
-    printf("%.0lf\n", arr[x][y]);
+    printf("%.0lf\n", arr[(x * 8) + y]);
     // printf("X: %d \t Y: %d\n", x, y);
     printf("\n");
 }
@@ -0,0 +1,519 @@
+#include <bmp_simd.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SIMD_X86 1
+    #include <immintrin.h>
+#endif
+
+#define FIX_BITS 14 // Fractional bits of the fixed point DCT matrix
+#define PIXEL_BITS 3 // Fractional bits of the fixed point pixels and coefficients
+#define COLOR_BITS 15 // Fractional bits of the fixed point color conversion
+#define Y_R 9798 // 0.299 in Q15
+#define Y_G 19234 // 0.587 in Q15 (rounded down, so that the three weights sum to 1.0)
+#define Y_B 3736 // 0.114 in Q15
+
+// DCT-II matrix, M[u][x] = c(u) / 2 * cos((2x + 1) * u * pi / 16), so F = M * X * Mt and X = Mt * F * M
+float DCT_MATRIX[64], DCT_MATRIX_T[64];
+short DCT_MATRIX_FIX[64], DCT_MATRIX_T_FIX[64];
+
+SIMD_KERNELS KERNELS;
+pthread_once_t KERNELS_ONCE = PTHREAD_ONCE_INIT; // The first callers of simd_kernels can be several threads at once
+
+void init_dct_matrix(); // Fills the float and fixed point DCT matrices
+void init_kernels(); // Detects the CPU and fills KERNELS, run once by simd_kernels
+void matmul_float_scalar(float *, const float *, const float *); // out = a * b for 8x8 float matrices
+void matmul_int16_scalar(short *, const short *, const short *); // out = a * b for 8x8 fixed point matrices
+void foward_dct_float_scalar(double *);
+void inverse_dct_float_scalar(double *);
+void foward_dct_int16_scalar(double *);
+void inverse_dct_int16_scalar(double *);
+void to_float(float *, const double *); // Converts a block to float32
+void from_float(double *, const float *); // Converts a block back to double
+void to_int16(short *, const double *); // Converts a block to int16 fixed point
+void from_int16(double *, const short *); // Converts a fixed point block back to double
+void bgr_to_ycbcr_scalar(const unsigned char *, double *, double *, double *, unsigned int);
+void ycbcr_to_bgr_scalar(const double *, const double *, const double *, unsigned char *, unsigned int);
+unsigned char saturate(double); // Rounds to the nearest integer and clamps to 0..255
+
+void init_dct_matrix()
+{
+    double c = 0.0, value = 0.0;
+    for(int u = 0; u < 8; u++)
+    {
+        c = (u == 0) ? (1.0 / sqrt(2.0)) : 1.0;
+        for(int x = 0; x < 8; x++)
+        {
+            value = (c / 2.0) * cos(((2 * x) + 1) * u * M_PI / 16.0);
+            DCT_MATRIX[(u * 8) + x] = (float) value;
+            DCT_MATRIX_T[(x * 8) + u] = (float) value;
+            DCT_MATRIX_FIX[(u * 8) + x] = (short) lrint(value * (1 << FIX_BITS));
+            DCT_MATRIX_T_FIX[(x * 8) + u] = (short) lrint(value * (1 << FIX_BITS));
+        }
+    }
+}
+
+void to_float(float *out, const double *block)
+{
+    for(int k = 0; k < 64; k++)
+    {
+        out[k] = (float) block[k];
+    }
+}
+
+void from_float(double *block, const float *in)
+{
+    for(int k = 0; k < 64; k++)
+    {
+        block[k] = in[k];
+    }
+}
+
+void to_int16(short *out, const double *block)
+{
+    long value = 0;
+    for(int k = 0; k < 64; k++)
+    {
+        value = lrint(block[k] * (1 << PIXEL_BITS));
+        if(value > 32767) value = 32767;
+        if(value < -32768) value = -32768;
+        out[k] = (short) value;
+    }
+}
+
+void from_int16(double *block, const short *in)
+{
+    for(int k = 0; k < 64; k++)
+    {
+        block[k] = in[k] / (double) (1 << PIXEL_BITS);
+    }
+}
+
+void matmul_float_scalar(float *out, const float *a, const float *b)
+{
+    float sum = 0.0f;
+    for(int i = 0; i < 8; i++)
+    {
+        for(int j = 0; j < 8; j++)
+        {
+            sum = 0.0f;
+            for(int k = 0; k < 8; k++)
+            {
+                sum += a[(i * 8) + k] * b[(k * 8) + j];
+            }
+            out[(i * 8) + j] = sum;
+        }
+    }
+}
+
+void matmul_int16_scalar(short *out, const short *a, const short *b)
+{
+    int sum = 0;
+    for(int i = 0; i < 8; i++)
+    {
+        for(int j = 0; j < 8; j++)
+        {
+            sum = 1 << (FIX_BITS - 1);
+            for(int k = 0; k < 8; k++)
+            {
+                sum += a[(i * 8) + k] * b[(k * 8) + j];
+            }
+            sum >>= FIX_BITS;
+            if(sum > 32767) sum = 32767;
+            if(sum < -32768) sum = -32768;
+            out[(i * 8) + j] = (short) sum;
+        }
+    }
+}
+
+void foward_dct_float_scalar(double *block)
+{
+    float x[64], t[64];
+    to_float(x, block);
+    matmul_float_scalar(t, x, DCT_MATRIX_T);
+    matmul_float_scalar(x, DCT_MATRIX, t);
+    from_float(block, x);
+}
+
+void inverse_dct_float_scalar(double *block)
+{
+    float x[64], t[64];
+    to_float(x, block);
+    matmul_float_scalar(t, x, DCT_MATRIX);
+    matmul_float_scalar(x, DCT_MATRIX_T, t);
+    from_float(block, x);
+}
+
+void foward_dct_int16_scalar(double *block)
+{
+    short x[64], t[64];
+    to_int16(x, block);
+    matmul_int16_scalar(t, x, DCT_MATRIX_T_FIX);
+    matmul_int16_scalar(x, DCT_MATRIX_FIX, t);
+    from_int16(block, x);
+}
+
+void inverse_dct_int16_scalar(double *block)
+{
+    short x[64], t[64];
+    to_int16(x, block);
+    matmul_int16_scalar(t, x, DCT_MATRIX_FIX);
+    matmul_int16_scalar(x, DCT_MATRIX_T_FIX, t);
+    from_int16(block, x);
+}
+
+void bgr_to_ycbcr_scalar(const unsigned char *bgr, double *y, double *cb, double *cr, unsigned int pixels)
+{
+    int luma = 0;
+    for(unsigned int p = 0; p < pixels; p++, bgr += 3)
+    {
+        // Y in Q15, Cb and Cr are scaled back to double together with their 0.564 and 0.713 weights
+        luma = (Y_R * bgr[2]) + (Y_G * bgr[1]) + (Y_B * bgr[0]);
+        y[p] = luma * (1.0 / (1 << COLOR_BITS));
+        cb[p] = ((bgr[0] << COLOR_BITS) - luma) * (0.564 / (1 << COLOR_BITS));
+        cr[p] = ((bgr[2] << COLOR_BITS) - luma) * (0.713 / (1 << COLOR_BITS));
+    }
+}
+
+unsigned char saturate(double value)
+{
+    long rounded = lrint(value);
+    if(rounded < 0) rounded = 0;
+    if(rounded > 255) rounded = 255;
+    return (unsigned char) rounded;
+}
+
+void ycbcr_to_bgr_scalar(const double *y, const double *cb, const double *cr, unsigned char *bgr, unsigned int pixels)
+{
+    for(unsigned int p = 0; p < pixels; p++)
+    {
+        *bgr++ = saturate(y[p] + (1.772 * cb[p]));
+        *bgr++ = saturate(y[p] - (0.344 * cb[p]) - (0.714 * cr[p]));
+        *bgr++ = saturate(y[p] + (1.402 * cr[p]));
+    }
+}
+
+#ifdef SIMD_X86
+// Every row of the output is a sum of the rows of b weighted by a row of a, so a block row fits in the vectors
+
+__attribute__((target("sse2"))) void matmul_float_sse2(float *out, const float *a, const float *b)
+{
+    __m128 b_lo[8], b_hi[8], acc_lo, acc_hi, weight;
+    for(int k = 0; k < 8; k++)
+    {
+        b_lo[k] = _mm_loadu_ps(b + (k * 8));
+        b_hi[k] = _mm_loadu_ps(b + (k * 8) + 4);
+    }
+    for(int i = 0; i < 8; i++)
+    {
+        acc_lo = _mm_setzero_ps();
+        acc_hi = _mm_setzero_ps();
+        for(int k = 0; k < 8; k++)
+        {
+            weight = _mm_set1_ps(a[(i * 8) + k]);
+            acc_lo = _mm_add_ps(acc_lo, _mm_mul_ps(weight, b_lo[k]));
+            acc_hi = _mm_add_ps(acc_hi, _mm_mul_ps(weight, b_hi[k]));
+        }
+        _mm_storeu_ps(out + (i * 8), acc_lo);
+        _mm_storeu_ps(out + (i * 8) + 4, acc_hi);
+    }
+}
+
+__attribute__((target("sse2"))) void matmul_int16_sse2(short *out, const short *a, const short *b)
+{
+    __m128i b_lo[4], b_hi[4], row0, row1, acc_lo, acc_hi, weights;
+    const __m128i round = _mm_set1_epi32(1 << (FIX_BITS - 1));
+    // Interleave the rows of b in pairs, so madd multiplies and sums two terms of the dot product at once
+    for(int p = 0; p < 4; p++)
+    {
+        row0 = _mm_loadu_si128((const __m128i *) (b + (p * 16)));
+        row1 = _mm_loadu_si128((const __m128i *) (b + (p * 16) + 8));
+        b_lo[p] = _mm_unpacklo_epi16(row0, row1);
+        b_hi[p] = _mm_unpackhi_epi16(row0, row1);
+    }
+    for(int i = 0; i < 8; i++)
+    {
+        acc_lo = round;
+        acc_hi = round;
+        for(int p = 0; p < 4; p++)
+        {
+            weights = _mm_set1_epi32((unsigned short) a[(i * 8) + (2 * p)] | ((unsigned int) (unsigned short) a[(i * 8) + (2 * p) + 1] << 16));
+            acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(weights, b_lo[p]));
+            acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(weights, b_hi[p]));
+        }
+        acc_lo = _mm_srai_epi32(acc_lo, FIX_BITS);
+        acc_hi = _mm_srai_epi32(acc_hi, FIX_BITS);
+        _mm_storeu_si128((__m128i *) (out + (i * 8)), _mm_packs_epi32(acc_lo, acc_hi));
+    }
+}
+
+__attribute__((target("avx2"))) void matmul_float_avx2(float *out, const float *a, const float *b)
+{
+    __m256 rows[8], acc;
+    for(int k = 0; k < 8; k++)
+    {
+        rows[k] = _mm256_loadu_ps(b + (k * 8));
+    }
+    for(int i = 0; i < 8; i++)
+    {
+        acc = _mm256_setzero_ps();
+        for(int k = 0; k < 8; k++)
+        {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(a[(i * 8) + k]), rows[k]));
+        }
+        _mm256_storeu_ps(out + (i * 8), acc);
+    }
+}
+
+__attribute__((target("avx2"))) void matmul_int16_avx2(short *out, const short *a, const short *b)
+{
+    __m256i b_lo[4], b_hi[4], acc_lo, acc_hi, weights;
+    __m128i row0, row1;
+    const __m256i round = _mm256_set1_epi32(1 << (FIX_BITS - 1));
+    for(int p = 0; p < 4; p++)
+    {
+        row0 = _mm_loadu_si128((const __m128i *) (b + (p * 16)));
+        row1 = _mm_loadu_si128((const __m128i *) (b + (p * 16) + 8));
+        b_lo[p] = _mm256_broadcastsi128_si256(_mm_unpacklo_epi16(row0, row1));
+        b_hi[p] = _mm256_broadcastsi128_si256(_mm_unpackhi_epi16(row0, row1));
+    }
+    // Two output rows per vector, one in each 128 bits lane
+    for(int i = 0; i < 8; i += 2)
+    {
+        acc_lo = round;
+        acc_hi = round;
+        for(int p = 0; p < 4; p++)
+        {
+            weights = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                        _mm_set1_epi32((unsigned short) a[(i * 8) + (2 * p)] | ((unsigned int) (unsigned short) a[(i * 8) + (2 * p) + 1] << 16))),
+                        _mm_set1_epi32((unsigned short) a[((i + 1) * 8) + (2 * p)] | ((unsigned int) (unsigned short) a[((i + 1) * 8) + (2 * p) + 1] << 16)), 1);
+            acc_lo = _mm256_add_epi32(acc_lo, _mm256_madd_epi16(weights, b_lo[p]));
+            acc_hi = _mm256_add_epi32(acc_hi, _mm256_madd_epi16(weights, b_hi[p]));
+        }
+        acc_lo = _mm256_srai_epi32(acc_lo, FIX_BITS);
+        acc_hi = _mm256_srai_epi32(acc_hi, FIX_BITS);
+        _mm256_storeu_si256((__m256i *) (out + (i * 8)), _mm256_packs_epi32(acc_lo, acc_hi));
+    }
+}
+
+__attribute__((target("sse2"))) void to_int16_sse2(short *out, const double *block)
+{
+    const __m128d scale = _mm_set1_pd(1 << PIXEL_BITS);
+    __m128i a, b, c, d;
+    for(int k = 0; k < 64; k += 8)
+    {
+        a = _mm_cvtpd_epi32(_mm_mul_pd(_mm_loadu_pd(block + k), scale));
+        b = _mm_cvtpd_epi32(_mm_mul_pd(_mm_loadu_pd(block + k + 2), scale));
+        c = _mm_cvtpd_epi32(_mm_mul_pd(_mm_loadu_pd(block + k + 4), scale));
+        d = _mm_cvtpd_epi32(_mm_mul_pd(_mm_loadu_pd(block + k + 6), scale));
+        _mm_storeu_si128((__m128i *) (out + k), _mm_packs_epi32(_mm_unpacklo_epi64(a, b), _mm_unpacklo_epi64(c, d)));
+    }
+}
+
+__attribute__((target("sse2"))) void from_int16_sse2(double *block, const short *in)
+{
+    const __m128d scale = _mm_set1_pd(1.0 / (1 << PIXEL_BITS));
+    __m128i x, lo, hi;
+    for(int k = 0; k < 64; k += 8)
+    {
+        x = _mm_loadu_si128((const __m128i *) (in + k));
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_pd(block + k, _mm_mul_pd(_mm_cvtepi32_pd(lo), scale));
+        _mm_storeu_pd(block + k + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), scale));
+        _mm_storeu_pd(block + k + 4, _mm_mul_pd(_mm_cvtepi32_pd(hi), scale));
+        _mm_storeu_pd(block + k + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), scale));
+    }
+}
+
+__attribute__((target("sse2"))) void foward_dct_float_sse2(double *block)
+{
+    float x[64], t[64];
+    to_float(x, block);
+    matmul_float_sse2(t, x, DCT_MATRIX_T);
+    matmul_float_sse2(x, DCT_MATRIX, t);
+    from_float(block, x);
+}
+
+__attribute__((target("sse2"))) void inverse_dct_float_sse2(double *block)
+{
+    float x[64], t[64];
+    to_float(x, block);
+    matmul_float_sse2(t, x, DCT_MATRIX);
+    matmul_float_sse2(x, DCT_MATRIX_T, t);
+    from_float(block, x);
+}
+
+__attribute__((target("sse2"))) void foward_dct_int16_sse2(double *block)
+{
+    short x[64], t[64];
+    to_int16_sse2(x, block);
+    matmul_int16_sse2(t, x, DCT_MATRIX_T_FIX);
+    matmul_int16_sse2(x, DCT_MATRIX_FIX, t);
+    from_int16_sse2(block, x);
+}
+
+__attribute__((target("sse2"))) void inverse_dct_int16_sse2(double *block)
+{
+    short x[64], t[64];
+    to_int16_sse2(x, block);
+    matmul_int16_sse2(t, x, DCT_MATRIX_FIX);
+    matmul_int16_sse2(x, DCT_MATRIX_T_FIX, t);
+    from_int16_sse2(block, x);
+}
+
+__attribute__((target("avx2"))) void foward_dct_float_avx2(double *block)
+{
+    float x[64], t[64];
+    to_float(x, block);
+    matmul_float_avx2(t, x, DCT_MATRIX_T);
+    matmul_float_avx2(x, DCT_MATRIX, t);
+    from_float(block, x);
+}
+
+__attribute__((target("avx2"))) void inverse_dct_float_avx2(double *block)
+{
+    float x[64], t[64];
+    to_float(x, block);
+    matmul_float_avx2(t, x, DCT_MATRIX);
+    matmul_float_avx2(x, DCT_MATRIX_T, t);
+    from_float(block, x);
+}
+
+__attribute__((target("avx2"))) void foward_dct_int16_avx2(double *block)
+{
+    short x[64], t[64];
+    to_int16_sse2(x, block);
+    matmul_int16_avx2(t, x, DCT_MATRIX_T_FIX);
+    matmul_int16_avx2(x, DCT_MATRIX_FIX, t);
+    from_int16_sse2(block, x);
+}
+
+__attribute__((target("avx2"))) void inverse_dct_int16_avx2(double *block)
+{
+    short x[64], t[64];
+    to_int16_sse2(x, block);
+    matmul_int16_avx2(t, x, DCT_MATRIX_FIX);
+    matmul_int16_avx2(x, DCT_MATRIX_T_FIX, t);
+    from_int16_sse2(block, x);
+}
+
+__attribute__((target("ssse3"))) void store_ycbcr_ssse3(double *y, double *cb, double *cr, __m128i luma, __m128i blue, __m128i red)
+{
+    const __m128d y_scale = _mm_set1_pd(1.0 / (1 << COLOR_BITS));
+    const __m128d cb_scale = _mm_set1_pd(0.564 / (1 << COLOR_BITS));
+    const __m128d cr_scale = _mm_set1_pd(0.713 / (1 << COLOR_BITS));
+    __m128i chroma;
+    _mm_storeu_pd(y, _mm_mul_pd(_mm_cvtepi32_pd(luma), y_scale));
+    _mm_storeu_pd(y + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(luma, 8)), y_scale));
+    chroma = _mm_sub_epi32(_mm_slli_epi32(blue, COLOR_BITS), luma);
+    _mm_storeu_pd(cb, _mm_mul_pd(_mm_cvtepi32_pd(chroma), cb_scale));
+    _mm_storeu_pd(cb + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(chroma, 8)), cb_scale));
+    chroma = _mm_sub_epi32(_mm_slli_epi32(red, COLOR_BITS), luma);
+    _mm_storeu_pd(cr, _mm_mul_pd(_mm_cvtepi32_pd(chroma), cr_scale));
+    _mm_storeu_pd(cr + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(chroma, 8)), cr_scale));
+}
+
+__attribute__((target("ssse3"))) void bgr_to_ycbcr_ssse3(const unsigned char *bgr, double *y, double *cb, double *cr, unsigned int pixels)
+{
+    // Deinterleave 4 pixels (12 bytes) of a 16 bytes load: (r, g) pairs, and b and r zero extended to 32 bits
+    const __m128i rg_mask = _mm_setr_epi8(2, -1, 1, -1, 5, -1, 4, -1, 8, -1, 7, -1, 11, -1, 10, -1);
+    const __m128i b_mask = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+    const __m128i r_mask = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+    const __m128i rg_weights = _mm_set1_epi32(Y_R | (Y_G << 16));
+    const __m128i b_weight = _mm_set1_epi32(Y_B);
+    __m128i pixels4, blue, red, luma;
+    unsigned int p = 0;
+
+    // Each load reads 4 bytes past its 4 pixels, so stop while 6 pixels are left
+    for(; (p + 6) <= pixels; p += 4, bgr += 12)
+    {
+        pixels4 = _mm_loadu_si128((const __m128i *) bgr);
+        blue = _mm_shuffle_epi8(pixels4, b_mask);
+        red = _mm_shuffle_epi8(pixels4, r_mask);
+        luma = _mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(pixels4, rg_mask), rg_weights), _mm_madd_epi16(blue, b_weight));
+        store_ycbcr_ssse3(y + p, cb + p, cr + p, luma, blue, red);
+    }
+    bgr_to_ycbcr_scalar(bgr, y + p, cb + p, cr + p, pixels - p);
+}
+
+__attribute__((target("ssse3"))) __m128i round_4_ssse3(__m128d lo, __m128d hi)
+{
+    return _mm_unpacklo_epi64(_mm_cvtpd_epi32(lo), _mm_cvtpd_epi32(hi));
+}
+
+__attribute__((target("ssse3"))) void ycbcr_to_bgr_ssse3(const double *y, const double *cb, const double *cr, unsigned char *bgr, unsigned int pixels)
+{
+    // Gathers the bytes b0..b3 g0..g3 r0..r3 back into b g r triples
+    const __m128i bgr_mask = _mm_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+    const __m128d cb_blue = _mm_set1_pd(1.772), cb_green = _mm_set1_pd(0.344), cr_green = _mm_set1_pd(0.714), cr_red = _mm_set1_pd(1.402);
+    __m128d y_lo, y_hi, cb_lo, cb_hi, cr_lo, cr_hi;
+    __m128i blue, green, red, packed;
+    unsigned int p = 0;
+    int tail = 0;
+    for(; (p + 4) <= pixels; p += 4, bgr += 12)
+    {
+        y_lo = _mm_loadu_pd(y + p);
+        y_hi = _mm_loadu_pd(y + p + 2);
+        cb_lo = _mm_loadu_pd(cb + p);
+        cb_hi = _mm_loadu_pd(cb + p + 2);
+        cr_lo = _mm_loadu_pd(cr + p);
+        cr_hi = _mm_loadu_pd(cr + p + 2);
+        blue = round_4_ssse3(_mm_add_pd(y_lo, _mm_mul_pd(cb_blue, cb_lo)), _mm_add_pd(y_hi, _mm_mul_pd(cb_blue, cb_hi)));
+        green = round_4_ssse3(_mm_sub_pd(_mm_sub_pd(y_lo, _mm_mul_pd(cb_green, cb_lo)), _mm_mul_pd(cr_green, cr_lo)),
+                              _mm_sub_pd(_mm_sub_pd(y_hi, _mm_mul_pd(cb_green, cb_hi)), _mm_mul_pd(cr_green, cr_hi)));
+        red = round_4_ssse3(_mm_add_pd(y_lo, _mm_mul_pd(cr_red, cr_lo)), _mm_add_pd(y_hi, _mm_mul_pd(cr_red, cr_hi)));
+        // Saturating packs clamp to 0..255 instead of wrapping around
+        packed = _mm_packus_epi16(_mm_packs_epi32(blue, green), _mm_packs_epi32(red, _mm_setzero_si128()));
+        packed = _mm_shuffle_epi8(packed, bgr_mask);
+        _mm_storel_epi64((__m128i *) bgr, packed);
+        tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+        memcpy(bgr + 8, &tail, sizeof(tail)); // The pixels are not aligned to 4 bytes
+    }
+    ycbcr_to_bgr_scalar(y + p, cb + p, cr + p, bgr, pixels - p);
+}
+#endif
+
+const SIMD_KERNELS *simd_kernels()
+{
+    pthread_once(&KERNELS_ONCE, init_kernels);
+    return &KERNELS;
+}
+
+void init_kernels()
+{
+    init_dct_matrix();
+    KERNELS.isa = SIMD_SCALAR;
+    KERNELS.foward_dct_float = foward_dct_float_scalar;
+    KERNELS.inverse_dct_float = inverse_dct_float_scalar;
+    KERNELS.foward_dct_int16 = foward_dct_int16_scalar;
+    KERNELS.inverse_dct_int16 = inverse_dct_int16_scalar;
+    KERNELS.bgr_to_ycbcr = bgr_to_ycbcr_scalar;
+    KERNELS.ycbcr_to_bgr = ycbcr_to_bgr_scalar;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("ssse3"))
+    {
+        KERNELS.bgr_to_ycbcr = bgr_to_ycbcr_ssse3;
+        KERNELS.ycbcr_to_bgr = ycbcr_to_bgr_ssse3;
+    }
+    if(__builtin_cpu_supports("avx2"))
+    {
+        KERNELS.isa = SIMD_AVX2;
+        KERNELS.foward_dct_float = foward_dct_float_avx2;
+        KERNELS.inverse_dct_float = inverse_dct_float_avx2;
+        KERNELS.foward_dct_int16 = foward_dct_int16_avx2;
+        KERNELS.inverse_dct_int16 = inverse_dct_int16_avx2;
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        KERNELS.isa = SIMD_SSE2;
+        KERNELS.foward_dct_float = foward_dct_float_sse2;
+        KERNELS.inverse_dct_float = inverse_dct_float_sse2;
+        KERNELS.foward_dct_int16 = foward_dct_int16_sse2;
+        KERNELS.inverse_dct_int16 = inverse_dct_int16_sse2;
+    }
+#endif
+}
@@ -0,0 +1,206 @@
+#include <container.h>
+#include <error_handler.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_HEADER 8 // Tag and length of a chunk
+#define QUANT_BYTES 128 // Both quantization tables
+
+extern _Thread_local unsigned int ERROR;
+
+void put_u16(FILE *, unsigned short); // Writes 16 bits in little endian
+void put_u32(FILE *, unsigned int); // Writes 32 bits in little endian
+unsigned short get_u16(const unsigned char *); // Reads 16 bits in little endian
+unsigned int get_u32(const unsigned char *); // Reads 32 bits in little endian
+void put_chunk(FILE *, const char *, unsigned int); // Writes the tag and the length of a chunk
+void put_offsets(FILE *, const char *, unsigned int, unsigned int, const unsigned int *); // Writes a SIDX or BIDX chunk: blocks by entry, entries, then the entries
+unsigned int *get_offsets(FILE *, unsigned int, unsigned int *, unsigned int *); // Reads the bytes of a SIDX or BIDX chunk of that length, NULL if they do not add up
+
+void container_write(FILE *arq, const CONTAINER *container)
+{
+    unsigned short chunks = 2; // QTAB and DATA are always there
+    if(container->has_bmp_header != 0) chunks++;
+    if(container->offsets != NULL) chunks++;
+    if(container->index != NULL) chunks++;
+    fwrite(CONTAINER_MAGIC, 1, 4, arq);
+    put_u16(arq, CONTAINER_VERSION);
+    put_u16(arq, CONTAINER_HEADER_BYTES);
+    put_u32(arq, container->width);
+    put_u32(arq, container->height);
+    put_u16(arq, container->format);
+    put_u16(arq, container->predictor);
+    fputc(container->dct_engine, arq);
+    fputc(container->subsampling, arq);
+    put_u16(arq, chunks);
+
+    put_chunk(arq, "QTAB", QUANT_BYTES);
+    fwrite(container->quant, 1, QUANT_BYTES, arq);
+    if(container->has_bmp_header != 0)
+    {
+        put_chunk(arq, "BMPH", CONTAINER_BMP_HEADER);
+        fwrite(container->bmp_header, 1, CONTAINER_BMP_HEADER, arq);
+    }
+    if(container->offsets != NULL) put_offsets(arq, "SIDX", container->segment_blocks, container->segments, container->offsets);
+    if(container->index != NULL) put_offsets(arq, "BIDX", container->index_blocks, container->entries, container->index);
+    put_chunk(arq, "DATA", (container->data_bytes <= 0xFFFFFFFFULL) ? (unsigned int) container->data_bytes : 0); // The coded bytes follow
+}
+
+int container_read(FILE *arq, CONTAINER *container)
+{
+    unsigned char header[CONTAINER_HEADER_BYTES], chunk[CHUNK_HEADER];
+    unsigned short header_bytes = 0, chunks = 0;
+    unsigned int length = 0;
+    int err = 0, data = 0, quant = 0;
+    memset(container, 0, sizeof(CONTAINER));
+    if(fread(header, 1, CONTAINER_HEADER_BYTES, arq) == CONTAINER_HEADER_BYTES && memcmp(header, CONTAINER_MAGIC, 4) == 0)
+    {
+        container->version = get_u16(header + 4);
+        header_bytes = get_u16(header + 6);
+        container->width = get_u32(header + 8);
+        container->height = get_u32(header + 12);
+        container->format = get_u16(header + 16);
+        container->predictor = get_u16(header + 18);
+        container->dct_engine = header[20];
+        container->subsampling = header[21];
+        chunks = get_u16(header + 22);
+        if(container->version == 0 || container->version > CONTAINER_VERSION)
+        {
+            ERROR = ERR_UNSUPPORTED_FILE;
+            err = -1;
+        }
+        else if(header_bytes < CONTAINER_HEADER_BYTES)
+        {
+            ERROR = ERR_CORRUPTED_FILE;
+            err = -1;
+        }
+        else
+        {
+            fseek(arq, header_bytes - CONTAINER_HEADER_BYTES, SEEK_CUR);
+            for(unsigned short k = 0; err == 0 && data == 0 && k < chunks; k++)
+            {
+                if(fread(chunk, 1, CHUNK_HEADER, arq) != CHUNK_HEADER)
+                {
+                    err = -1;
+                }
+                else
+                {
+                    length = get_u32(chunk + 4);
+                    if(memcmp(chunk, "QTAB", 4) == 0)
+                    {
+                        quant = 1;
+                        if(length != QUANT_BYTES || fread(container->quant, 1, QUANT_BYTES, arq) != QUANT_BYTES) err = -1;
+                    }
+                    else if(memcmp(chunk, "BMPH", 4) == 0)
+                    {
+                        container->has_bmp_header = 1;
+                        if(length != CONTAINER_BMP_HEADER || fread(container->bmp_header, 1, CONTAINER_BMP_HEADER, arq) != CONTAINER_BMP_HEADER) err = -1;
+                    }
+                    else if(memcmp(chunk, "SIDX", 4) == 0 && container->offsets == NULL)
+                    {
+                        container->offsets = get_offsets(arq, length, &container->segment_blocks, &container->segments);
+                        if(container->offsets == NULL) err = -1;
+                    }
+                    else if(memcmp(chunk, "BIDX", 4) == 0 && container->index == NULL)
+                    {
+                        container->index = get_offsets(arq, length, &container->index_blocks, &container->entries);
+                        if(container->index == NULL) err = -1;
+                    }
+                    else if(memcmp(chunk, "DATA", 4) == 0)
+                    {
+                        container->data_bytes = length;
+                        data = 1;
+                    }
+                    else // Chunk of a newer version, or a repeated one
+                    {
+                        if(fseek(arq, length, SEEK_CUR) != 0) err = -1;
+                    }
+                }
+            }
+            if(err == 0 && (data == 0 || quant == 0)) err = -1;
+            if(err != 0 && ERROR != ERR_ALLOCATE_MEMORY) ERROR = ERR_CORRUPTED_FILE;
+        }
+    }
+    else
+    {
+        ERROR = ERR_CORRUPTED_FILE;
+        err = -1;
+    }
+    if(err != 0) container_free(container);
+    return err;
+}
+
+void container_free(CONTAINER *container)
+{
+    free(container->offsets);
+    free(container->index);
+    container->offsets = NULL;
+    container->index = NULL;
+}
+
+void put_u16(FILE *arq, unsigned short value)
+{
+    fputc(value & 0xFF, arq);
+    fputc(value >> 8, arq);
+}
+
+void put_u32(FILE *arq, unsigned int value)
+{
+    put_u16(arq, (unsigned short) (value & 0xFFFF));
+    put_u16(arq, (unsigned short) (value >> 16));
+}
+
+unsigned short get_u16(const unsigned char *data)
+{
+    return (unsigned short) (data[0] | (data[1] << 8));
+}
+
+unsigned int get_u32(const unsigned char *data)
+{
+    return (unsigned int) get_u16(data) | ((unsigned int) get_u16(data + 2) << 16);
+}
+
+void put_chunk(FILE *arq, const char *tag, unsigned int length)
+{
+    fwrite(tag, 1, 4, arq);
+    put_u32(arq, length);
+}
+
+void put_offsets(FILE *arq, const char *tag, unsigned int blocks, unsigned int count, const unsigned int *values)
+{
+    put_chunk(arq, tag, 8 + (count * 4));
+    put_u32(arq, blocks);
+    put_u32(arq, count);
+    for(unsigned int i = 0; i < count; i++)
+    {
+        put_u32(arq, values[i]);
+    }
+}
+
+unsigned int *get_offsets(FILE *arq, unsigned int length, unsigned int *blocks, unsigned int *count)
+{
+    unsigned char bytes[8];
+    unsigned int *values = NULL;
+    if(length >= 8 && fread(bytes, 1, 8, arq) == 8)
+    {
+        *blocks = get_u32(bytes);
+        *count = get_u32(bytes + 4);
+        if(*count > 0 && *count == ((length - 8) / 4) && (length % 4) == 0)
+        {
+            values = (unsigned int *) malloc(*count * sizeof(unsigned int));
+            if(values == NULL) ERROR = ERR_ALLOCATE_MEMORY;
+            for(unsigned int i = 0; values != NULL && i < *count; i++)
+            {
+                if(fread(bytes, 1, 4, arq) == 4)
+                {
+                    values[i] = get_u32(bytes);
+                }
+                else
+                {
+                    free(values);
+                    values = NULL;
+                }
+            }
+        }
+    }
+    return values;
+}
@@ -29,6 +29,22 @@ void error_catch(unsigned int err_code)
             printf("ERROR: You must write a valid bmp file!\n");
             break;
 
+        case ERR_CORRUPTED_FILE:
+            printf("ERROR: The compressed file is corrupted!\n");
+            break;
+
+        case ERR_UNSUPPORTED_FILE:
+            printf("ERROR: The compressed file needs a newer version of the program!\n");
+            break;
+
+        case WARN_STANDARD_TABLES:
+            printf("WARNING: The optimized tables could not be made, the file was written with the standard ones!\n");
+            break;
+
+        case WARN_STREAM_RUN_SIZE:
+            printf("WARNING: The streaming compression makes one pass, the file was written in the runsize format!\n");
+            break;
+
         default:
             break;
     }
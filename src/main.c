@@ -1,46 +1,152 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <bmp_handler.h>
+#include <batch.h>
+
+void usage(); // Print how to use the program
 
 int main(int argc, char *argv[])
 {
 	BMP_FILE *bmp = NULL;
+	BATCH_SETTINGS settings;
+	BATCH_REPORT report;
 	char in_file[100], out_file[100];
-	if(argc == 4)
+	unsigned char engine = DCT_REFERENCE;
+	unsigned short format = FORMAT_WORDS, predictor = PREDICT_ZIGZAG;
+	unsigned int segments = 0, index = 0, threads = 1;
+	char *end = NULL;
+	int valid = 1, streamable = 1; // -t and -i are not taken by bmp_compress_stream, they clear streamable
+	if(argc >= 4)
 	{
-		if(strcmp(argv[1], "-c") == 0)
+		// Options between the mode and the file names
+		for(int i = 2; i < (argc - 2); i++)
+		{
+			if(strcmp(argv[i], "-t") == 0 && (i + 1) < (argc - 2))
+			{
+				i++;
+				if(strcmp(argv[i], "fast") == 0) engine = DCT_FAST;
+				else if(strcmp(argv[i], "reference") == 0) engine = DCT_REFERENCE;
+				else if(strcmp(argv[i], "float") == 0) engine = DCT_FLOAT;
+				else if(strcmp(argv[i], "int16") == 0) engine = DCT_INT16;
+				else valid = 0;
+				streamable = 0;
+			}
+			else if(strcmp(argv[i], "-e") == 0 && (i + 1) < (argc - 2))
+			{
+				i++;
+				if(strcmp(argv[i], "words") == 0) format = FORMAT_WORDS;
+				else if(strcmp(argv[i], "stream") == 0) format = FORMAT_STREAM;
+				else if(strcmp(argv[i], "runsize") == 0) format = FORMAT_RUN_SIZE;
+				else if(strcmp(argv[i], "optimized") == 0) format = FORMAT_OPTIMIZED;
+				else if(strcmp(argv[i], "rans") == 0) format = FORMAT_RANS;
+				else valid = 0;
+			}
+			else if(strcmp(argv[i], "-p") == 0 && (i + 1) < (argc - 2))
+			{
+				i++;
+				if(strcmp(argv[i], "zigzag") == 0) predictor = PREDICT_ZIGZAG;
+				else if(strcmp(argv[i], "dc") == 0) predictor = PREDICT_DC;
+				else valid = 0;
+			}
+			else if(strcmp(argv[i], "-r") == 0 && (i + 1) < (argc - 2))
+			{
+				i++;
+				segments = (unsigned int) strtoul(argv[i], &end, 10);
+				if(*end != '\0') valid = 0;
+			}
+			else if(strcmp(argv[i], "-i") == 0 && (i + 1) < (argc - 2))
+			{
+				i++;
+				index = (unsigned int) strtoul(argv[i], &end, 10);
+				if(*end != '\0') valid = 0;
+				streamable = 0;
+			}
+			else if(strcmp(argv[i], "-j") == 0 && (i + 1) < (argc - 2))
+			{
+				i++;
+				threads = (unsigned int) strtoul(argv[i], &end, 10);
+				if(*end != '\0') valid = 0;
+			}
+			else
+			{
+				valid = 0;
+			}
+		}
+		strncpy(in_file, argv[argc - 2], sizeof(in_file));
+		strncpy(out_file, argv[argc - 1], sizeof(out_file));
+
+		if(valid == 0)
 		{
-			strncpy(in_file, argv[2], sizeof(in_file));
-			strncpy(out_file, argv[3], sizeof(out_file));
-			bmp = bmp_read_file(in_file);
+			printf("Invalid arguments!\n");
+			usage();
+		}
+		else if(strcmp(argv[1], "-c") == 0)
+		{
+			bmp = bmp_map_file(in_file);
+			bmp_set_dct_engine(bmp, engine);
+			bmp_set_threads(bmp, threads);
+			bmp_set_format(bmp, format);
+			bmp_set_predictor(bmp, predictor);
+			bmp_set_segments(bmp, segments);
+			bmp_set_index(bmp, index);
 			bmp_dct(bmp, 0);
 			bmp_quantization(bmp);
 			bmp_diff_encode(bmp);
 			bmp_compress(bmp, out_file);
 		}
+		else if(strcmp(argv[1], "-s") == 0 && streamable == 0)
+		{
+			printf("The -t and -i arguments can not be used with -s!\n");
+			usage();
+		}
+		else if(strcmp(argv[1], "-s") == 0)
+		{
+			bmp_compress_stream(in_file, out_file, format, predictor, segments, threads);
+		}
+		else if(strcmp(argv[1], "-b") == 0)
+		{
+			settings.engine = engine;
+			settings.format = format;
+			settings.predictor = predictor;
+			settings.segment_blocks = segments;
+			settings.index_blocks = index;
+			settings.threads = threads;
+			if(batch_compress(in_file, out_file, &settings, &report) == 0)
+			{
+				printf("%u images (%u failed) in %.3f s: %.2f images/s, %.2f MB/s read, %.2f MB/s written\n", report.images, report.failed, report.seconds,
+					(report.seconds > 0.0) ? (report.images / report.seconds) : 0.0,
+					(report.seconds > 0.0) ? (report.read_bytes / report.seconds / 1e6) : 0.0,
+					(report.seconds > 0.0) ? (report.written_bytes / report.seconds / 1e6) : 0.0);
+			}
+		}
 		else if(strcmp(argv[1], "-d") == 0)
 		{
-			strncpy(in_file, argv[2], sizeof(in_file));
-			strncpy(out_file, argv[3], sizeof(out_file));
-			bmp = bmp_decompress(in_file);
+			bmp = bmp_decompress_parallel(in_file, threads);
+			bmp_set_dct_engine(bmp, engine);
 			bmp_diff_decode(bmp);
 			bmp_inverse_quantization(bmp);
 			bmp_dct(bmp, -1);
 			bmp_write_file(out_file, bmp);
 		}
-		else 
+		else
 		{
 			printf("Invalid arguments!\n");
-			printf("For use: ./main [-c | -d] <input_file_name> <output_file_name>\n");
-			printf("IMPORTANT: For -c argument, the input file must have .bmp extension, and for -d argument, output file must have .bmp extension\n");
+			usage();
 		}
 		bmp_destroy(&bmp);
 	}
-	else 
+	else
 	{
 		printf("Few arguments!\n");
-		printf("For use: ./main [-c | -d] <input_file_name> <output_file_name>\n");
-		printf("IMPORTANT: For -c argument, the input file must have .bmp extension, and for -d argument, output file must have .bmp extension\n");
+		usage();
 	}
 	return 0;
 }
+
+void usage()
+{
+	printf("For use: ./main [-c | -s | -d | -b] [-t reference | fast | float | int16] [-e words | stream | runsize | optimized | rans] [-p zigzag | dc] [-r <blocks>] [-i <blocks>] [-j <threads>] <input_file_name> <output_file_name>\n");
+	printf("IMPORTANT: For -c and -s arguments, the input file must have .bmp extension, and for -d argument, output file must have .bmp extension\n");
+	printf("For -b, the input is a folder of .bmp files or a file listing one image by line, and the output is the folder of the compressed files\n");
+}
@@ -0,0 +1,179 @@
+#include <rans.h>
+#include <error_handler.h>
+#include <stdlib.h>
+
+extern _Thread_local unsigned int ERROR;
+
+void rans_model_update(RANS_MODEL *, unsigned char); // Moves the distribution towards the symbol seen
+void rans_record(RANS_ENCODER *, unsigned int, unsigned int); // Appends a slot to the record, growing it when full
+void rans_advance(RANS_DECODER *, unsigned int, unsigned int, unsigned int); // Removes a decoded slot from the current state and renormalizes it
+
+void rans_model_init(RANS_MODEL *model, unsigned char symbols)
+{
+    model->symbols = symbols;
+    for(int i = 0; i <= symbols; i++)
+    {
+        model->cdf[i] = (i * RANS_TOTAL) / symbols;
+    }
+}
+
+void rans_model_update(RANS_MODEL *model, unsigned char symbol)
+{
+    int target = 0;
+    // Each boundary moves towards a distribution with all the mass on the symbol, keeping one slot for every other symbol
+    for(int i = 1; i < model->symbols; i++)
+    {
+        target = (i <= symbol) ? i : (RANS_TOTAL - (model->symbols - i));
+        model->cdf[i] += (target - model->cdf[i]) >> RANS_RATE;
+    }
+}
+
+int rans_encoder_open(RANS_ENCODER *encoder)
+{
+    int err = 0;
+    encoder->count = 0;
+    encoder->capacity = 1 << 16;
+    encoder->symbols = (RANS_SYMBOL *) malloc(encoder->capacity * sizeof(RANS_SYMBOL));
+    if(encoder->symbols == NULL)
+    {
+        encoder->capacity = 0;
+        ERROR = ERR_ALLOCATE_MEMORY;
+        err = -1;
+    }
+    return err;
+}
+
+void rans_record(RANS_ENCODER *encoder, unsigned int start, unsigned int freq)
+{
+    RANS_SYMBOL *symbols = NULL;
+    if(encoder->count == encoder->capacity)
+    {
+        symbols = (RANS_SYMBOL *) realloc(encoder->symbols, 2 * encoder->capacity * sizeof(RANS_SYMBOL));
+        if(symbols == NULL)
+        {
+            ERROR = ERR_ALLOCATE_MEMORY;
+            return;
+        }
+        encoder->symbols = symbols;
+        encoder->capacity *= 2;
+    }
+    encoder->symbols[encoder->count].start = (unsigned short) start;
+    encoder->symbols[encoder->count].freq = (unsigned short) freq;
+    encoder->count++;
+}
+
+void rans_encode(RANS_ENCODER *encoder, RANS_MODEL *model, unsigned char symbol)
+{
+    rans_record(encoder, model->cdf[symbol], model->cdf[symbol + 1] - model->cdf[symbol]);
+    rans_model_update(model, symbol);
+}
+
+void rans_encode_bits(RANS_ENCODER *encoder, unsigned int value, unsigned char bits)
+{
+    if(bits > 0)
+    {
+        rans_record(encoder, value << (RANS_SCALE_BITS - bits), 1U << (RANS_SCALE_BITS - bits));
+    }
+}
+
+unsigned char *rans_encoder_finish(RANS_ENCODER *encoder, size_t *size)
+{
+    // A symbol takes at most RANS_SCALE_BITS bits, plus the two states flushed at the end
+    size_t capacity = ((encoder->count * RANS_SCALE_BITS) / 8) + 16;
+    unsigned char *data = (unsigned char *) malloc(capacity), *ptr = NULL;
+    unsigned int state[2] = { RANS_LOW, RANS_LOW }, limit = 0, k = 0;
+    if(data != NULL)
+    {
+        // The decoder reads the bytes forward, so they are written from the end, coding the last symbol first
+        ptr = data + capacity;
+        for(size_t i = encoder->count; i > 0; i--)
+        {
+            k = (i - 1) & 1;
+            limit = ((RANS_LOW >> RANS_SCALE_BITS) << 8) * encoder->symbols[i - 1].freq;
+            while(state[k] >= limit)
+            {
+                *(--ptr) = (unsigned char) state[k];
+                state[k] >>= 8;
+            }
+            state[k] = ((state[k] / encoder->symbols[i - 1].freq) << RANS_SCALE_BITS) + (state[k] % encoder->symbols[i - 1].freq) + encoder->symbols[i - 1].start;
+        }
+        // The state of the even symbols is read first
+        for(int s = 1; s >= 0; s--)
+        {
+            *(--ptr) = (unsigned char) state[s];
+            *(--ptr) = (unsigned char) (state[s] >> 8);
+            *(--ptr) = (unsigned char) (state[s] >> 16);
+            *(--ptr) = (unsigned char) (state[s] >> 24);
+        }
+        *size = (data + capacity) - ptr;
+        for(size_t i = 0; i < *size; i++)
+        {
+            data[i] = ptr[i];
+        }
+    }
+    else
+    {
+        *size = 0;
+        ERROR = ERR_ALLOCATE_MEMORY;
+    }
+    return data;
+}
+
+void rans_encoder_close(RANS_ENCODER *encoder)
+{
+    free(encoder->symbols);
+    encoder->symbols = NULL;
+    encoder->count = 0;
+    encoder->capacity = 0;
+}
+
+void rans_decoder_open(RANS_DECODER *decoder, const unsigned char *data, size_t size)
+{
+    decoder->data = data;
+    decoder->end = data + size;
+    decoder->next = 0;
+    for(int s = 0; s < 2; s++)
+    {
+        decoder->state[s] = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            decoder->state[s] = (decoder->state[s] << 8) | ((decoder->data < decoder->end) ? *(decoder->data++) : 0);
+        }
+    }
+}
+
+void rans_advance(RANS_DECODER *decoder, unsigned int slot, unsigned int start, unsigned int freq)
+{
+    unsigned int *state = &decoder->state[decoder->next];
+    *state = (freq * ((*state) >> RANS_SCALE_BITS)) + slot - start;
+    while(*state < RANS_LOW && decoder->data < decoder->end) // A valid stream never runs out here, a truncated one would loop on a zero state
+    {
+        *state = ((*state) << 8) | *(decoder->data++);
+    }
+    decoder->next ^= 1;
+}
+
+unsigned char rans_decode(RANS_DECODER *decoder, RANS_MODEL *model)
+{
+    unsigned int slot = decoder->state[decoder->next] & (RANS_TOTAL - 1);
+    unsigned char symbol = 0;
+    while(slot >= (unsigned int) model->cdf[symbol + 1])
+    {
+        symbol++;
+    }
+    rans_advance(decoder, slot, model->cdf[symbol], model->cdf[symbol + 1] - model->cdf[symbol]);
+    rans_model_update(model, symbol);
+    return symbol;
+}
+
+unsigned int rans_decode_bits(RANS_DECODER *decoder, unsigned char bits)
+{
+    unsigned int slot = 0, value = 0;
+    if(bits > 0)
+    {
+        slot = decoder->state[decoder->next] & (RANS_TOTAL - 1);
+        value = slot >> (RANS_SCALE_BITS - bits);
+        rans_advance(decoder, slot, value << (RANS_SCALE_BITS - bits), 1U << (RANS_SCALE_BITS - bits));
+    }
+    return value;
+}
@@ -0,0 +1,102 @@
+#include <ring_buffer.h>
+#include <error_handler.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RING_LINE 64 // Bytes of a cache line, the producer and the consumer counters live in different ones
+#define RING_SPINS 64 // Yields before a waiting thread starts to sleep
+#define RING_SLEEP 50000 // Nanoseconds of each sleep, short next to the time of a band
+
+extern _Thread_local unsigned int ERROR;
+
+struct t_ring_buffer
+{
+    void **slots;
+    unsigned int mask; // Slots minus one
+    char pad_head[RING_LINE];
+    atomic_uint head; // Items popped, written by the consumer only
+    char pad_tail[RING_LINE];
+    atomic_uint tail; // Items pushed, written by the producer only
+    char pad_end[RING_LINE];
+};
+
+void ring_buffer_wait(unsigned int *); // Gives the core away while a ring is full or empty, sleeping once the yields are spent
+
+RING_BUFFER *ring_buffer_create(unsigned int capacity)
+{
+    RING_BUFFER *ring = (RING_BUFFER *) malloc(sizeof(RING_BUFFER));
+    unsigned int slots = 1;
+    while(slots < capacity)
+    {
+        slots <<= 1;
+    }
+    if(ring != NULL)
+    {
+        ring->slots = (void **) malloc(slots * sizeof(void *));
+        ring->mask = slots - 1;
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        if(ring->slots == NULL)
+        {
+            free(ring);
+            ring = NULL;
+            ERROR = ERR_ALLOCATE_MEMORY;
+        }
+    }
+    else
+    {
+        ERROR = ERR_ALLOCATE_MEMORY;
+    }
+    return ring;
+}
+
+void ring_buffer_push(RING_BUFFER *ring, void *item)
+{
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed), spins = 0;
+    // The counters only grow, their difference stays right when they wrap around
+    while((tail - atomic_load_explicit(&ring->head, memory_order_acquire)) > ring->mask)
+    {
+        ring_buffer_wait(&spins);
+    }
+    ring->slots[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release); // Publishes the slot to the consumer
+}
+
+void *ring_buffer_pop(RING_BUFFER *ring)
+{
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed), spins = 0;
+    void *item = NULL;
+    while(atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+    {
+        ring_buffer_wait(&spins);
+    }
+    item = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release); // Gives the slot back to the producer
+    return item;
+}
+
+void ring_buffer_wait(unsigned int *spins)
+{
+    struct timespec pause = { 0, RING_SLEEP };
+    if(*spins < RING_SPINS)
+    {
+        (*spins)++;
+        sched_yield();
+    }
+    else
+    {
+        nanosleep(&pause, NULL);
+    }
+}
+
+void ring_buffer_destroy(RING_BUFFER **ring)
+{
+    if(*ring != NULL)
+    {
+        free((*ring)->slots);
+        free(*ring);
+        *ring = NULL;
+    }
+}
@@ -0,0 +1,218 @@
+#include <thread_pool.h>
+#include <error_handler.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+#define CHUNKS_BY_THREAD 8 // Chunks of a job for each thread when the caller lets the pool choose, to even out slow chunks
+
+extern _Thread_local unsigned int ERROR;
+
+// Job posted by thread_pool_run, lives in the stack of its caller until every chunk is done
+typedef struct t_thread_job
+{
+    THREAD_TASK task;
+    void *arg;
+    unsigned int items;
+    unsigned int chunk;
+    unsigned int chunks; // Chunks of the job, the last one can be shorter
+    atomic_uint next; // Next chunk of the job to be claimed
+    unsigned int helpers; // Workers inside the job, the caller waits for them to leave
+    unsigned int error; // First error of a helper, handed to the caller when the job is done
+    struct t_thread_job *link; // Job posted before this one
+} THREAD_JOB;
+
+struct t_thread_pool
+{
+    pthread_t *workers; // Threads besides the caller
+    unsigned int threads; // Workers plus the caller
+    pthread_mutex_t lock; // Guards everything below and the helpers and link of the jobs
+    pthread_cond_t start; // Signaled when a job is posted or the pool stops
+    pthread_cond_t done; // Signaled when the last helper leaves a job
+    THREAD_JOB *jobs; // Open jobs, the newest first
+    unsigned char stop; // Set by thread_pool_destroy
+};
+
+void *thread_pool_worker(void *); // Loop of a worker, helps with the newest job that still has chunks, or waits for one
+THREAD_JOB *thread_pool_pick(THREAD_POOL *); // Newest open job with chunks left, NULL if there is none, called with the lock held
+void thread_pool_chunks(THREAD_JOB *); // Claims and runs chunks of a job until none is left
+
+THREAD_POOL *thread_pool_create(unsigned int threads)
+{
+    THREAD_POOL *pool = (THREAD_POOL *) malloc(sizeof(THREAD_POOL));
+    unsigned int started = 0;
+    if(threads == 0) threads = thread_pool_cores();
+    if(pool != NULL)
+    {
+        pool->threads = 1;
+        pool->jobs = NULL;
+        pool->stop = 0;
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->start, NULL);
+        pthread_cond_init(&pool->done, NULL);
+        pool->workers = (threads > 1) ? (pthread_t *) malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+        if(pool->workers != NULL)
+        {
+            // A worker that could not start just leaves the pool smaller
+            for(started = 0; started < (threads - 1); started++)
+            {
+                if(pthread_create(&pool->workers[started], NULL, thread_pool_worker, pool) != 0) break;
+            }
+            pool->threads = started + 1;
+        }
+        else if(threads > 1)
+        {
+            ERROR = ERR_ALLOCATE_MEMORY;
+        }
+    }
+    else
+    {
+        ERROR = ERR_ALLOCATE_MEMORY;
+    }
+    return pool;
+}
+
+void *thread_pool_worker(void *arg)
+{
+    THREAD_POOL *pool = (THREAD_POOL *) arg;
+    THREAD_JOB *job = NULL;
+    pthread_mutex_lock(&pool->lock);
+    while(pool->stop == 0)
+    {
+        job = thread_pool_pick(pool);
+        if(job == NULL)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        else
+        {
+            job->helpers++;
+            pthread_mutex_unlock(&pool->lock);
+            thread_pool_chunks(job);
+            pthread_mutex_lock(&pool->lock);
+            if(ERROR != 0 && job->error == 0) job->error = ERROR;
+            ERROR = 0;
+            job->helpers--;
+            if(job->helpers == 0) pthread_cond_broadcast(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+THREAD_JOB *thread_pool_pick(THREAD_POOL *pool)
+{
+    THREAD_JOB *job = pool->jobs;
+    // The newest jobs are the nested ones, finishing them first frees the threads waiting on them
+    while(job != NULL && atomic_load(&job->next) >= job->chunks)
+    {
+        job = job->link;
+    }
+    return job;
+}
+
+void thread_pool_chunks(THREAD_JOB *job)
+{
+    unsigned int first = 0;
+    while(1)
+    {
+        first = atomic_fetch_add(&job->next, 1);
+        if(first >= job->chunks)
+        {
+            break;
+        }
+        else
+        {
+            first *= job->chunk;
+            job->task(job->arg, first, ((job->items - first) < job->chunk) ? (job->items - first) : job->chunk);
+        }
+    }
+}
+
+void thread_pool_run(THREAD_POOL *pool, THREAD_TASK task, void *arg, unsigned int items, unsigned int chunk)
+{
+    THREAD_JOB job, **prev = NULL;
+    if(pool == NULL || pool->threads == 1)
+    {
+        if(items > 0) task(arg, 0, items);
+    }
+    else if(items > 0)
+    {
+        if(chunk == 0) chunk = (items + (pool->threads * CHUNKS_BY_THREAD) - 1) / (pool->threads * CHUNKS_BY_THREAD);
+        job.task = task;
+        job.arg = arg;
+        job.items = items;
+        job.chunk = chunk;
+        job.chunks = (items + chunk - 1) / chunk;
+        atomic_init(&job.next, 0);
+        job.helpers = 0;
+        job.error = 0;
+        pthread_mutex_lock(&pool->lock);
+        job.link = pool->jobs;
+        pool->jobs = &job;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+
+        // Any task may post a job of its own here, the idle threads help with it
+        thread_pool_chunks(&job);
+
+        pthread_mutex_lock(&pool->lock);
+        while(job.helpers > 0)
+        {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        // Other jobs may have been posted on top of this one meanwhile
+        prev = &pool->jobs;
+        while(*prev != &job)
+        {
+            prev = &(*prev)->link;
+        }
+        *prev = job.link;
+        if(job.error != 0 && ERROR == 0) ERROR = job.error;
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+unsigned int thread_pool_threads(const THREAD_POOL *pool)
+{
+    return (pool != NULL) ? pool->threads : 1;
+}
+
+unsigned int thread_pool_cores()
+{
+    long cores = 1;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    cores = (long) info.dwNumberOfProcessors;
+#else
+    cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (cores > 0) ? (unsigned int) cores : 1;
+}
+
+void thread_pool_destroy(THREAD_POOL **pool)
+{
+    if(*pool != NULL)
+    {
+        pthread_mutex_lock(&(*pool)->lock);
+        (*pool)->stop = 1;
+        pthread_cond_broadcast(&(*pool)->start);
+        pthread_mutex_unlock(&(*pool)->lock);
+        for(unsigned int i = 0; i < ((*pool)->threads - 1); i++)
+        {
+            pthread_join((*pool)->workers[i], NULL);
+        }
+        pthread_cond_destroy(&(*pool)->start);
+        pthread_cond_destroy(&(*pool)->done);
+        pthread_mutex_destroy(&(*pool)->lock);
+        free((*pool)->workers);
+        free(*pool);
+        *pool = NULL;
+    }
+}
@@ -0,0 +1,124 @@
+#include <bmp_handler.h>
+#include <error_handler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Defined in bmp_handler.c
+extern _Thread_local unsigned int ERROR;
+
+int compress_optimized(const char *, const char *); // Writes the image in the optimized format, -1 if it could not
+long tables_offset(FILE *); // Offset of the first table, right after the header of the DATA chunk, -1 if there is none
+int check_table(const char *, const char *, const unsigned char *); // Writes these 16 counts over the first table and checks that the decoder drops the image, 1 if it does not
+int report(const char *, int); // Prints the result of a test and returns it
+
+int main(int argc, char *argv[])
+{
+    const char *image = (argc > 1) ? argv[1] : "./samples/rainbowgirl.bmp";
+    char name[] = "/tmp/test_corrupt_XXXXXX";
+    unsigned char counts[16];
+    BMP_FILE *bmp = NULL;
+    int failed = 0, fd = mkstemp(name);
+    if(fd >= 0 && compress_optimized(image, name) == 0)
+    {
+        close(fd);
+        bmp = bmp_decompress_parallel(name, 1);
+        failed += report("untouched tables", (bmp != NULL) ? 0 : 1);
+        bmp_destroy(&bmp);
+
+        // More values than the 256 symbols a table has
+        memset(counts, 0xFF, sizeof(counts));
+        failed += check_table(name, "256 values over", counts);
+
+        // Few values, but more codes of 1 bit than 1 bit can tell apart
+        memset(counts, 0, sizeof(counts));
+        counts[0] = 3;
+        failed += check_table(name, "kraft inequality", counts);
+
+        // One code of each length up to 11 bits and three of 12, the last one would fill the lookup past its end
+        memset(counts, 1, 11);
+        counts[11] = 3;
+        failed += check_table(name, "lookup overflow", counts);
+        remove(name);
+    }
+    else
+    {
+        if(fd >= 0) close(fd);
+        remove(name);
+        printf("Can not compress %s\n", image);
+        failed = 1;
+    }
+    return (failed == 0) ? 0 : 1;
+}
+
+int compress_optimized(const char *image, const char *name)
+{
+    BMP_FILE *bmp = bmp_map_file(image);
+    int err = -1;
+    if(bmp != NULL)
+    {
+        bmp_set_format(bmp, FORMAT_OPTIMIZED);
+        bmp_dct(bmp, 0);
+        bmp_quantization(bmp);
+        bmp_diff_encode(bmp);
+        err = bmp_compress(bmp, name);
+        bmp_destroy(&bmp);
+    }
+    return err;
+}
+
+long tables_offset(FILE *arq)
+{
+    unsigned char header[8];
+    unsigned int length = 0;
+    long offset = 24, found = -1; // The chunks follow the 24 bytes of the container header
+    while(found < 0 && fseek(arq, offset, SEEK_SET) == 0 && fread(header, 1, sizeof(header), arq) == sizeof(header))
+    {
+        length = header[4] | (header[5] << 8) | (header[6] << 16) | ((unsigned int) header[7] << 24);
+        if(memcmp(header, "DATA", 4) == 0) found = offset + 8;
+        offset += 8 + (long) length;
+    }
+    return found;
+}
+
+int check_table(const char *name, const char *test, const unsigned char *counts)
+{
+    char copy[64];
+    unsigned char buffer[4096];
+    FILE *in = fopen(name, "rb"), *out = NULL;
+    BMP_FILE *bmp = NULL;
+    size_t read = 0;
+    long offset = -1;
+    int failed = 1;
+    snprintf(copy, sizeof(copy), "%s_bad", name);
+    out = fopen(copy, "wb");
+    if(in != NULL && out != NULL)
+    {
+        while((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        {
+            fwrite(buffer, 1, read, out);
+        }
+        offset = tables_offset(in);
+        if(offset > 0 && fseek(out, offset, SEEK_SET) == 0 && fwrite(counts, 1, 16, out) == 16)
+        {
+            fclose(out);
+            out = NULL;
+            ERROR = 0;
+            bmp = bmp_decompress_parallel(copy, 1);
+            failed = (bmp == NULL && ERROR == ERR_CORRUPTED_FILE) ? 0 : 1;
+            bmp_destroy(&bmp);
+            ERROR = 0;
+        }
+    }
+    if(in != NULL) fclose(in);
+    if(out != NULL) fclose(out);
+    remove(copy);
+    return report(test, failed);
+}
+
+int report(const char *name, int failed)
+{
+    printf("%-18s %s\n", name, (failed == 0) ? "ok" : "FAILED");
+    return failed;
+}
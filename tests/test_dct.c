@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define BLOCKS 20000 // Random blocks checked by each test
+#define AMPLITUDE 128.0 // Pixels are centered on zero before the DCT, coefficients go up to 8 times this
+#define EXACT 1e-9 // Separable passes against the direct sums, only the order of the additions differs
+#define AAN 1e-2 // AAN against the reference, its constants have 9 digits, still far below a quantization step
+
+// Defined in bmp_handler.c, which keeps them out of its header
+extern const double COS[8][8];
+extern const double C[8];
+extern const double AAN_SCALE[8];
+void foward_dct(double *);
+void inverse_dct(double *);
+void foward_dct_aan(double *);
+void inverse_dct_aan(double *);
+
+void direct_foward_dct(const double *, double *); // The DCT-II as the 64 terms sum of each output, as it was computed before the separable passes
+void direct_inverse_dct(const double *, double *); // Same for the inverse DCT-II
+void random_block(double *, double); // Fills a block with values in [-amplitude, amplitude)
+double largest_difference(const double *, const double *); // Largest absolute difference between two blocks
+int report(const char *, double, double); // Prints the result of a test, 1 if the difference is over the tolerance
+
+int main()
+{
+    double block[64], expected[64], coefficients[64], worst[4] = { 0.0, 0.0, 0.0, 0.0 }, d = 0.0;
+    int failed = 0;
+    srand(1);
+    for(int n = 0; n < BLOCKS; n++)
+    {
+        // foward_dct against the direct sums
+        random_block(block, AMPLITUDE);
+        direct_foward_dct(block, expected);
+        foward_dct(block);
+        d = largest_difference(block, expected);
+        if(d > worst[0]) worst[0] = d;
+
+        // inverse_dct against the direct sums, on coefficients of the size the foward DCT gives
+        random_block(coefficients, 8.0 * AMPLITUDE);
+        direct_inverse_dct(coefficients, expected);
+        for(int k = 0; k < 64; k++) block[k] = coefficients[k];
+        inverse_dct(block);
+        d = largest_difference(block, expected);
+        if(d > worst[1]) worst[1] = d;
+
+        // foward_dct_aan outputs 8 times the DCT-II times the scale of the row and of the column
+        random_block(block, AMPLITUDE);
+        direct_foward_dct(block, expected);
+        foward_dct_aan(block);
+        for(int k = 0; k < 64; k++) block[k] /= AAN_SCALE[k / 8] * AAN_SCALE[k % 8] * 8.0;
+        d = largest_difference(block, expected);
+        if(d > worst[2]) worst[2] = d;
+
+        // inverse_dct_aan takes the coefficients times that scale over 8, as the inverse quantization leaves them
+        random_block(coefficients, 8.0 * AMPLITUDE);
+        direct_inverse_dct(coefficients, expected);
+        for(int k = 0; k < 64; k++) block[k] = coefficients[k] * AAN_SCALE[k / 8] * AAN_SCALE[k % 8] / 8.0;
+        inverse_dct_aan(block);
+        d = largest_difference(block, expected);
+        if(d > worst[3]) worst[3] = d;
+    }
+    failed += report("foward_dct", worst[0], EXACT);
+    failed += report("inverse_dct", worst[1], EXACT);
+    failed += report("foward_dct_aan", worst[2], AAN);
+    failed += report("inverse_dct_aan", worst[3], AAN);
+    return (failed == 0) ? 0 : 1;
+}
+
+void direct_foward_dct(const double *in, double *out)
+{
+    double sum = 0.0;
+    for(int i = 0; i < 8; i++)
+    {
+        for(int j = 0; j < 8; j++)
+        {
+            sum = 0.0;
+            for(int x = 0; x < 8; x++)
+            {
+                for(int y = 0; y < 8; y++)
+                {
+                    sum += in[(x * 8) + y] * COS[i][x] * COS[j][y];
+                }
+            }
+            out[(i * 8) + j] = (1.0 / 4.0) * C[i] * C[j] * sum;
+        }
+    }
+}
+
+void direct_inverse_dct(const double *in, double *out)
+{
+    double sum = 0.0;
+    for(int x = 0; x < 8; x++)
+    {
+        for(int y = 0; y < 8; y++)
+        {
+            sum = 0.0;
+            for(int i = 0; i < 8; i++)
+            {
+                for(int j = 0; j < 8; j++)
+                {
+                    sum += C[i] * C[j] * in[(i * 8) + j] * COS[i][x] * COS[j][y];
+                }
+            }
+            out[(x * 8) + y] = (1.0 / 4.0) * sum;
+        }
+    }
+}
+
+void random_block(double *block, double amplitude)
+{
+    for(int k = 0; k < 64; k++)
+    {
+        block[k] = ((rand() / (RAND_MAX + 1.0)) * 2.0 - 1.0) * amplitude;
+    }
+}
+
+double largest_difference(const double *a, const double *b)
+{
+    double largest = 0.0;
+    for(int k = 0; k < 64; k++)
+    {
+        if(fabs(a[k] - b[k]) > largest) largest = fabs(a[k] - b[k]);
+    }
+    return largest;
+}
+
+int report(const char *name, double difference, double tolerance)
+{
+    int failed = (difference > tolerance) ? 1 : 0;
+    printf("%-16s largest difference %.3g (tolerance %.0g) %s\n", name, difference, tolerance, (failed == 0) ? "ok" : "FAILED");
+    return failed;
+}
@@ -0,0 +1,182 @@
+#include <bmp_handler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_CODE_LENGTH 16 // Same as in bmp_handler.c
+#define FIBONACCI 30 // Symbols with Fibonacci counts, their Huffman tree is 29 levels deep before the limit
+
+// Defined in bmp_handler.c, which keeps it out of its header
+void optimal_table(const unsigned long *, unsigned char *, unsigned char *);
+
+int write_block_image(const char *); // Writes a 8x8 BMP of random pixels, a single block, -1 if it could not
+int compress(const char *, const char *, unsigned short, unsigned short, unsigned int, unsigned int); // -c of an image with these options, -1 if it could not
+int round_trip(const char *, const char *, unsigned short, unsigned short, unsigned int, unsigned int); // Compresses, decodes and compresses the decoded coefficients again, 1 if the two files differ
+int same_files(const char *, const char *); // 1 if both files have the same bytes
+int check_limited_table(); // Codes FIBONACCI symbols, checks every one gets a code of at most MAX_CODE_LENGTH bits that fits the Kraft inequality, 1 if not
+int report(const char *, int); // Prints the result of a test and returns it
+
+int main(int argc, char *argv[])
+{
+    const char *sample = (argc > 1) ? argv[1] : "./samples/rainbowgirl.bmp";
+    const char *formats[5] = { "words", "stream", "runsize", "optimized", "rans" }; // By FORMAT_* value
+    char name[] = "/tmp/test_roundtrip_XXXXXX", block[64], test[64];
+    int failed = 0, fd = mkstemp(name);
+    srand(1);
+    snprintf(block, sizeof(block), "%s_block.bmp", name);
+    if(fd >= 0 && write_block_image(block) == 0)
+    {
+        close(fd);
+        // The decoder of words loses the blocks it packs (see the known issues of the README), only the other layouts are checked
+        for(unsigned short format = FORMAT_STREAM; format <= FORMAT_RANS; format++)
+        {
+            snprintf(test, sizeof(test), "%s", formats[format]);
+            failed += report(test, round_trip(sample, name, format, PREDICT_ZIGZAG, 0, 0));
+            snprintf(test, sizeof(test), "%s -p dc -r 37", formats[format]);
+            failed += report(test, round_trip(sample, name, format, PREDICT_DC, 37, 0));
+            snprintf(test, sizeof(test), "%s one block", formats[format]);
+            failed += report(test, round_trip(block, name, format, PREDICT_DC, 0, 0));
+        }
+        // rANS ignores the index, it only starts at the start of a segment
+        for(unsigned short format = FORMAT_STREAM; format <= FORMAT_OPTIMIZED; format++)
+        {
+            snprintf(test, sizeof(test), "%s -p dc -i 16", formats[format]);
+            failed += report(test, round_trip(sample, name, format, PREDICT_DC, 0, 16));
+        }
+        failed += report("limited table", check_limited_table());
+    }
+    else
+    {
+        if(fd >= 0) close(fd);
+        printf("Can not write %s\n", block);
+        failed = 1;
+    }
+    remove(name);
+    remove(block);
+    return (failed == 0) ? 0 : 1;
+}
+
+int write_block_image(const char *name)
+{
+    unsigned char header[54], pixels[8 * 8 * 3];
+    unsigned int fields[6] = { sizeof(header) + sizeof(pixels), 0, sizeof(header), 40, 8, 8 }; // Sizes at the offsets 2, 6, 10, 14, 18 and 22
+    FILE *arq = fopen(name, "wb");
+    int err = -1;
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    for(int f = 0; f < 6; f++)
+    {
+        for(int b = 0; b < 4; b++)
+        {
+            header[2 + (4 * f) + b] = (unsigned char) (fields[f] >> (8 * b));
+        }
+    }
+    header[26] = 1; // Planes
+    header[28] = 24; // Bits by pixel
+    header[34] = (unsigned char) sizeof(pixels); // Image size
+    for(unsigned int k = 0; k < sizeof(pixels); k++)
+    {
+        pixels[k] = (unsigned char) (rand() & 0xFF);
+    }
+    if(arq != NULL)
+    {
+        if(fwrite(header, 1, sizeof(header), arq) == sizeof(header) && fwrite(pixels, 1, sizeof(pixels), arq) == sizeof(pixels)) err = 0;
+        if(fclose(arq) != 0) err = -1;
+    }
+    return err;
+}
+
+int compress(const char *image, const char *name, unsigned short format, unsigned short predictor, unsigned int segments, unsigned int index)
+{
+    BMP_FILE *bmp = bmp_map_file(image);
+    int err = -1;
+    if(bmp != NULL)
+    {
+        bmp_set_format(bmp, format);
+        bmp_set_predictor(bmp, predictor);
+        bmp_set_segments(bmp, segments);
+        bmp_set_index(bmp, index);
+        bmp_dct(bmp, 0);
+        bmp_quantization(bmp);
+        bmp_diff_encode(bmp);
+        err = bmp_compress(bmp, name);
+        bmp_destroy(&bmp);
+    }
+    return err;
+}
+
+int round_trip(const char *image, const char *name, unsigned short format, unsigned short predictor, unsigned int segments, unsigned int index)
+{
+    char again[64];
+    BMP_FILE *bmp = NULL;
+    int failed = 1;
+    snprintf(again, sizeof(again), "%s_again", name);
+    if(compress(image, name, format, predictor, segments, index) == 0)
+    {
+        // The decoded blocks are still quantized and delta encoded, the coder is deterministic so the same blocks give the same bytes
+        bmp = bmp_decompress_parallel(name, 1);
+        if(bmp != NULL && bmp_compress(bmp, again) == 0)
+        {
+            failed = (same_files(name, again) == 1) ? 0 : 1;
+        }
+        bmp_destroy(&bmp);
+    }
+    remove(again);
+    return failed;
+}
+
+int same_files(const char *a, const char *b)
+{
+    FILE *x = fopen(a, "rb"), *y = fopen(b, "rb");
+    int c = 0, d = 0, same = 0;
+    if(x != NULL && y != NULL)
+    {
+        do
+        {
+            c = fgetc(x);
+            d = fgetc(y);
+        } while(c == d && c != EOF);
+        same = (c == d) ? 1 : 0;
+    }
+    if(x != NULL) fclose(x);
+    if(y != NULL) fclose(y);
+    return same;
+}
+
+int check_limited_table()
+{
+    unsigned long counts[256];
+    unsigned char bits[MAX_CODE_LENGTH + 1], values[256], seen[256];
+    unsigned int codes = 0, space = 0;
+    int failed = 0;
+    memset(counts, 0, sizeof(counts));
+    memset(seen, 0, sizeof(seen));
+    counts[0] = 1;
+    counts[1] = 1;
+    for(int k = 2; k < FIBONACCI; k++)
+    {
+        counts[k] = counts[k - 1] + counts[k - 2];
+    }
+    optimal_table(counts, bits, values);
+    for(int length = 1; length <= MAX_CODE_LENGTH; length++)
+    {
+        codes += bits[length];
+        space += (unsigned int) bits[length] << (MAX_CODE_LENGTH - length);
+    }
+    // One code of MAX_CODE_LENGTH bits stays free, so no code is made only of ones
+    if(codes != FIBONACCI || space >= (1U << MAX_CODE_LENGTH)) failed = 1;
+    for(unsigned int k = 0; failed == 0 && k < codes; k++)
+    {
+        if(values[k] >= FIBONACCI || seen[values[k]] != 0) failed = 1;
+        seen[values[k]] = 1;
+    }
+    return failed;
+}
+
+int report(const char *name, int failed)
+{
+    printf("%-26s %s\n", name, (failed == 0) ? "ok" : "FAILED");
+    return failed;
+}
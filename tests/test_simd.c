@@ -0,0 +1,120 @@
+#include <bmp_simd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIXELS 4099 // Longest run converted, not a multiple of the vector widths so that the scalar tails run too
+#define ROUNDS 2000 // Random runs of every length checked
+#define BLOCKS 20000 // Random blocks checked by each DCT kernel
+
+// Defined in bmp_simd.c, the kernels used when the CPU has no vector instructions
+void bgr_to_ycbcr_scalar(const unsigned char *, double *, double *, double *, unsigned int);
+void ycbcr_to_bgr_scalar(const double *, const double *, const double *, unsigned char *, unsigned int);
+void foward_dct_float_scalar(double *);
+void inverse_dct_float_scalar(double *);
+void foward_dct_int16_scalar(double *);
+void inverse_dct_int16_scalar(double *);
+
+int check_to_ycbcr(const SIMD_KERNELS *); // Compares the BGR24 to YCbCr kernel with the scalar one, 1 if they differ
+int check_to_bgr(const SIMD_KERNELS *); // Compares the YCbCr to BGR24 kernel with the scalar one, clamping included, 1 if they differ
+int check_dct(const char *, void (*)(double *), void (*)(double *), double); // Compares a DCT kernel with its scalar version on blocks of that amplitude, 1 if they differ
+double random_value(double, double); // Uniform value in [low, high)
+int report(const char *, int); // Prints the result of a test and returns it
+
+int main()
+{
+    const SIMD_KERNELS *kernels = simd_kernels();
+    int failed = 0;
+    const char *isa[3] = { "scalar", "SSE2", "AVX2" };
+    srand(1);
+    printf("DCT kernels: %s, color kernels: %s\n", isa[kernels->isa], (kernels->bgr_to_ycbcr != bgr_to_ycbcr_scalar) ? "SSSE3" : "scalar");
+    failed += check_to_ycbcr(kernels);
+    failed += check_to_bgr(kernels);
+    // The matrix kernels are bit exact too, the vector lanes add the same products in the same order
+    failed += check_dct("foward_dct_float", kernels->foward_dct_float, foward_dct_float_scalar, 128.0);
+    failed += check_dct("inverse_dct_float", kernels->inverse_dct_float, inverse_dct_float_scalar, 1024.0);
+    failed += check_dct("foward_dct_int16", kernels->foward_dct_int16, foward_dct_int16_scalar, 128.0);
+    failed += check_dct("inverse_dct_int16", kernels->inverse_dct_int16, inverse_dct_int16_scalar, 1024.0);
+    return (failed == 0) ? 0 : 1;
+}
+
+int check_to_ycbcr(const SIMD_KERNELS *kernels)
+{
+    unsigned char bgr[PIXELS * 3];
+    double *channels = (double *) malloc(6 * PIXELS * sizeof(double));
+    unsigned int pixels = 0;
+    int failed = (channels == NULL) ? 1 : 0;
+    for(int round = 0; failed == 0 && round < ROUNDS; round++)
+    {
+        // Every length up to 67 pixels, then random ones up to the longest
+        pixels = (round < 68) ? (unsigned int) round : (unsigned int) (rand() % (PIXELS + 1));
+        for(unsigned int k = 0; k < (pixels * 3); k++)
+        {
+            bgr[k] = (unsigned char) (rand() & 0xFF);
+        }
+        if(round == 68) memset(bgr, 0xFF, sizeof(bgr)); // The extremes once
+        if(round == 69) memset(bgr, 0x00, sizeof(bgr));
+        kernels->bgr_to_ycbcr(bgr, channels, channels + PIXELS, channels + (2 * PIXELS), pixels);
+        bgr_to_ycbcr_scalar(bgr, channels + (3 * PIXELS), channels + (4 * PIXELS), channels + (5 * PIXELS), pixels);
+        for(int c = 0; c < 3; c++)
+        {
+            if(memcmp(channels + (c * PIXELS), channels + ((c + 3) * PIXELS), pixels * sizeof(double)) != 0) failed = 1;
+        }
+    }
+    free(channels);
+    return report("bgr_to_ycbcr", failed);
+}
+
+int check_to_bgr(const SIMD_KERNELS *kernels)
+{
+    unsigned char bgr[2][PIXELS * 3];
+    double *channels = (double *) malloc(3 * PIXELS * sizeof(double));
+    unsigned int pixels = 0;
+    int failed = (channels == NULL) ? 1 : 0;
+    for(int round = 0; failed == 0 && round < ROUNDS; round++)
+    {
+        pixels = (round < 68) ? (unsigned int) round : (unsigned int) (rand() % (PIXELS + 1));
+        for(unsigned int k = 0; k < pixels; k++)
+        {
+            // Past 0..255 on purpose, the inverse DCT overshoots and the kernels must clamp alike
+            channels[k] = random_value(-64.0, 320.0);
+            channels[PIXELS + k] = random_value(-192.0, 192.0);
+            channels[(2 * PIXELS) + k] = random_value(-192.0, 192.0);
+            if((k % 7) == 0) channels[k] = (double) (rand() % 256) + 0.5; // Ties of the rounding
+        }
+        memset(bgr, 0, sizeof(bgr));
+        kernels->ycbcr_to_bgr(channels, channels + PIXELS, channels + (2 * PIXELS), bgr[0], pixels);
+        ycbcr_to_bgr_scalar(channels, channels + PIXELS, channels + (2 * PIXELS), bgr[1], pixels);
+        if(memcmp(bgr[0], bgr[1], sizeof(bgr[0])) != 0) failed = 1; // Also catches a store past the last pixel
+    }
+    free(channels);
+    return report("ycbcr_to_bgr", failed);
+}
+
+int check_dct(const char *name, void (*kernel)(double *), void (*scalar)(double *), double amplitude)
+{
+    double block[2][64];
+    int failed = 0;
+    for(int n = 0; failed == 0 && n < BLOCKS; n++)
+    {
+        for(int k = 0; k < 64; k++)
+        {
+            block[0][k] = block[1][k] = random_value(-amplitude, amplitude);
+        }
+        kernel(block[0]);
+        scalar(block[1]);
+        if(memcmp(block[0], block[1], sizeof(block[0])) != 0) failed = 1;
+    }
+    return report(name, failed);
+}
+
+double random_value(double low, double high)
+{
+    return low + ((rand() / (RAND_MAX + 1.0)) * (high - low));
+}
+
+int report(const char *name, int failed)
+{
+    printf("%-18s %s\n", name, (failed == 0) ? "bit exact" : "FAILED, differs from the scalar kernel");
+    return failed;
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Checks that the files written by -c, -s and -d do not depend on -j, by comparing them with the ones of one thread
+# Usage: test_threads.sh <program> <image.bmp>
+
+MAIN=$1
+IMAGE=$2
+DIR=$(mktemp -d)
+FAILED=0
+
+# Compares the output of a run with that many threads against the output of one thread
+check()
+{
+    if [ ! -s "$DIR/one" ]; then
+        echo "$1 wrote nothing"
+        FAILED=1
+    elif ! cmp -s "$DIR/one" "$DIR/many"; then
+        echo "$1 differs with -j $2"
+        FAILED=1
+    fi
+}
+
+for FORMAT in words stream runsize optimized rans; do
+    for SEGMENTS in 0 37 256; do
+        "$MAIN" -c -e $FORMAT -p dc -r $SEGMENTS -i 16 -j 1 "$IMAGE" "$DIR/one" > /dev/null
+        for THREADS in 2 3 0; do
+            "$MAIN" -c -e $FORMAT -p dc -r $SEGMENTS -i 16 -j $THREADS "$IMAGE" "$DIR/many" > /dev/null
+            check "-c -e $FORMAT -r $SEGMENTS" $THREADS
+        done
+
+        # The same file decoded by segments and runs of the index in parallel
+        cp "$DIR/one" "$DIR/coded"
+        "$MAIN" -d -j 1 "$DIR/coded" "$DIR/one" > /dev/null
+        for THREADS in 2 3 0; do
+            "$MAIN" -d -j $THREADS "$DIR/coded" "$DIR/many" > /dev/null
+            check "-d of -e $FORMAT -r $SEGMENTS" $THREADS
+        done
+    done
+
+    "$MAIN" -s -e $FORMAT -r 64 -j 1 "$IMAGE" "$DIR/one" > /dev/null
+    for THREADS in 2 3 0; do
+        "$MAIN" -s -e $FORMAT -r 64 -j $THREADS "$IMAGE" "$DIR/many" > /dev/null
+        check "-s -e $FORMAT" $THREADS
+    done
+done
+
+rm -rf "$DIR"
+if [ $FAILED -eq 0 ]; then
+    echo "test_threads: every output is the same for any -j"
+fi
+exit $FAILED